@@ -0,0 +1,39 @@
+/*  lysdr Software Defined Radio
+	(C) 2010-2011 Gordon JC Pearce MM0YEQ and others
+
+	audio.h
+	the interface every source of I/Q samples provides
+
+	This file is part of lysdr.
+
+	lysdr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	any later version.
+
+	lysdr is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with lysdr.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __AUDIO_H
+#define __AUDIO_H
+#include "sdr.h"
+
+typedef struct {
+	const char *name;
+	// open the source, set sdr->size and sdr->sample_rate, allocate sdr->iqSample
+	int (*start)(sdr_data_t *sdr);
+	// start calling sdr_process; ci and co ask for automatic connections
+	int (*connect)(sdr_data_t *sdr, gboolean ci, gboolean co);
+	// stop calling sdr_process and free what start allocated
+	int (*stop)(sdr_data_t *sdr);
+} audio_backend_t;
+
+#endif
+
+/* vim: set noexpandtab ai ts=4 sw=4 tw=4: */
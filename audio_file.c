@@ -0,0 +1,284 @@
+/*  lysdr Software Defined Radio
+	(C) 2010-2011 Gordon JC Pearce MM0YEQ and others
+
+	audio_file.c
+	read I/Q from a WAV or raw file instead of JACK, in real time or flat out
+
+	This file is part of lysdr.
+
+	lysdr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	any later version.
+
+	lysdr is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with lysdr.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <gtk/gtk.h>
+#include "sdr.h"
+#include "audio_file.h"
+
+static const gchar *format_names[] = { "wav", "s16", "s32", "f32", NULL };
+
+static gchar *file_path;
+static FILE *file;
+static gint file_format;
+static gint file_rate;
+static gint file_period;
+static gboolean file_realtime;
+static gint sample_bytes;	// bytes in one of I or Q
+static gint64 data_bytes;	// length of a WAV file's data chunk, -1 if it runs to the end
+static gint64 remaining;	// frames still to read before the samples end, or -1
+static guchar *raw;			// one period as it comes off the disk
+static gfloat *left, *right;	// and as sdr_process takes it
+static GThread *thread;
+static volatile gint quit;
+static guint64 frames;		// frames processed so far
+static gint64 busy;			// microseconds spent in sdr_process
+
+static guint16 le16(const guchar *p) {
+	return p[0] | (p[1] << 8);
+}
+
+static guint32 le32(const guchar *p) {
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((guint32)p[3] << 24);
+}
+
+static gboolean wav_open(void) {
+	// walk the chunks up to the start of the samples, checking the format on the way
+	guchar h[40];
+	guint32 len;
+	guint16 tag = 0, channels = 0, bits = 0;
+
+	if (fread(h, 1, 12, file) != 12 || memcmp(h, "RIFF", 4) || memcmp(h + 8, "WAVE", 4)) {
+		fprintf(stderr, "%s is not a WAV file\n", file_path);
+		return FALSE;
+	}
+	for (;;) {
+		if (fread(h, 1, 8, file) != 8) {
+			fprintf(stderr, "%s has no data chunk\n", file_path);
+			return FALSE;
+		}
+		len = le32(h + 4);
+		if (!memcmp(h, "data", 4)) {
+			// anything after it, LIST or id3 say, isn't samples; a writer that never
+			// went back to fill the length in leaves it all ones
+			data_bytes = (len == 0xffffffff) ? -1 : len;
+			break;
+		}
+		if (!memcmp(h, "fmt ", 4) && len >= 16) {
+			if (fread(h, 1, MIN(len, sizeof(h)), file) != MIN(len, sizeof(h)))
+				return FALSE;
+			tag = le16(h);
+			channels = le16(h + 2);
+			file_rate = le32(h + 4);
+			bits = le16(h + 14);
+			if (tag == 0xfffe && len >= 26)
+				tag = le16(h + 24);	// WAVE_FORMAT_EXTENSIBLE, the real tag is in the subformat
+			len -= MIN(len, sizeof(h));
+		}
+		fseek(file, len + (len & 1), SEEK_CUR);	// chunks are padded to an even length
+	}
+
+	if (file_rate <= 0) {
+		fprintf(stderr, "%s has no sample rate\n", file_path);
+		return FALSE;
+	}
+	if (channels != 2) {
+		fprintf(stderr, "%s has %d channels, I/Q needs 2\n", file_path, channels);
+		return FALSE;
+	}
+	if (tag == 1 && bits == 16) file_format = FILE_S16;
+	else if (tag == 1 && bits == 32) file_format = FILE_S32;
+	else if (tag == 3 && bits == 32) file_format = FILE_F32;
+	else {
+		fprintf(stderr, "%s: can't read %d bit samples of format %d\n", file_path, bits, tag);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static void file_convert(gint n) {
+	// split n interleaved frames from raw into left and right, as jack would give them
+	gint i;
+	gint16 *s16 = (gint16 *)raw;
+	gint32 *s32 = (gint32 *)raw;
+	guint32 *f32 = (guint32 *)raw;
+	union { guint32 i; gfloat f; } u;
+
+	switch (file_format) {
+		case FILE_S16:
+			for (i = 0; i < n; i++) {
+				left[i] = GINT16_FROM_LE(s16[2*i]) * (1.0f / 32768);
+				right[i] = GINT16_FROM_LE(s16[2*i+1]) * (1.0f / 32768);
+			}
+			break;
+		case FILE_S32:
+			for (i = 0; i < n; i++) {
+				left[i] = GINT32_FROM_LE(s32[2*i]) * (1.0f / 2147483648.0f);
+				right[i] = GINT32_FROM_LE(s32[2*i+1]) * (1.0f / 2147483648.0f);
+			}
+			break;
+		case FILE_F32:
+			// little-endian IEEE floats; swap the bytes as a word, then reinterpret them
+			for (i = 0; i < n; i++) {
+				u.i = GUINT32_FROM_LE(f32[2*i]);
+				left[i] = u.f;
+				u.i = GUINT32_FROM_LE(f32[2*i+1]);
+				right[i] = u.f;
+			}
+			break;
+	}
+}
+
+static gint file_read(sdr_data_t *sdr) {
+	// fill left and right with the next period, padding the last one with silence
+	// returns the number of frames that came from the file, 0 at the end
+	size_t got = fread(raw, 2 * sample_bytes, (remaining < 0) ? sdr->size : MIN(sdr->size, remaining), file);
+
+	if (got == 0)
+		return 0;
+	if (remaining > 0)
+		remaining -= got;
+	file_convert(got);
+	memset(left + got, 0, (sdr->size - got) * sizeof(gfloat));
+	memset(right + got, 0, (sdr->size - got) * sizeof(gfloat));
+	return got;
+}
+
+static void file_report(gint64 wall) {
+	// how much faster than real time the DSP chain ran through the file
+	gdouble length = (gdouble)frames / file_rate;
+
+	if (!frames) {
+		fprintf(stderr, "%s: no samples\n", file_path);
+		return;
+	}
+	fprintf(stderr, "%s: %.1f s of I/Q in %.2f s, %.0f samples/s, DSP load %.1f%%, %.1fx real time\n",
+		file_path, length, wall / 1e6, busy ? frames * 1e6 / busy : 0,
+		100 * busy / (length * 1e6), busy ? length * 1e6 / busy : 0);
+}
+
+void audio_file_run(sdr_data_t *sdr, audio_file_output output, gpointer data) {
+	// process the whole file in this thread, passing each period's output on if asked
+	gint64 start = g_get_monotonic_time(), epoch = start, due, t;
+	gint64 period = (gint64)sdr->size * G_USEC_PER_SEC / file_rate;
+	gint n;
+
+	while (!g_atomic_int_get(&quit) && (n = file_read(sdr))) {
+		t = g_get_monotonic_time();
+		sdr_process(sdr, left, right);
+		t = g_get_monotonic_time() - t;
+		busy += t;
+		load_record(&sdr->load, t, period);
+		frames += n;
+		if (output)
+			output(sdr, n, data);
+
+		if (file_realtime) {
+			// sleep until the next period would have arrived from a sound card;
+			// more than a period late, and a sound card would have overrun
+			due = epoch + frames * G_USEC_PER_SEC / file_rate;
+			t = due - g_get_monotonic_time();
+			if (t > 0)
+				g_usleep(t);
+			else if (t < -period) {
+				load_xrun(&sdr->load);
+				epoch -= t;		// carry on from now, as jack would
+			}
+		}
+	}
+	file_report(g_get_monotonic_time() - start);
+}
+
+static gpointer file_thread(gpointer psdr) {
+	// stand in for the JACK process callback
+	audio_file_run((sdr_data_t *)psdr, NULL, NULL);
+	return NULL;
+}
+
+gboolean audio_file_setup(const gchar *path, const gchar *format, gint rate, gint period, gboolean realtime) {
+	// remember what to read; format is NULL for a WAV file, or one of the raw formats
+	gint i = FILE_WAV;
+
+	if (format) {
+		for (i = 0; format_names[i]; i++)
+			if (!g_ascii_strcasecmp(format, format_names[i]))
+				break;
+		if (!format_names[i]) {
+			fprintf(stderr, "unknown input format \"%s\"\n", format);
+			return FALSE;
+		}
+	}
+	if (rate <= 0 || period <= 0) {
+		fprintf(stderr, "the input rate and period must be positive\n");
+		return FALSE;
+	}
+	file_path = g_strdup(path);
+	file_format = i;
+	file_rate = rate;
+	file_period = period;
+	file_realtime = realtime;
+	return TRUE;
+}
+
+static int audio_start(sdr_data_t *sdr) {
+	// open the file and read its header, if it has one
+	file = fopen(file_path, "rb");
+	if (!file) {
+		perror(file_path);
+		return 1;
+	}
+	data_bytes = -1;	// a raw file is samples to the end
+	if (file_format == FILE_WAV && !wav_open()) {
+		fclose(file);
+		file = NULL;
+		return 1;
+	}
+	sample_bytes = file_format == FILE_S16 ? 2 : 4;
+	remaining = (data_bytes < 0) ? -1 : data_bytes / (2 * sample_bytes);
+
+	sdr->size = file_period;
+	sdr->sample_rate = file_rate;
+	sdr->iqSample = g_new0(sdr_complex_t, sdr->size);
+	raw = g_malloc(sdr->size * 2 * sample_bytes);
+	left = g_new(gfloat, sdr->size);
+	right = g_new(gfloat, sdr->size);
+	frames = 0;
+	busy = 0;
+	g_atomic_int_set(&quit, FALSE);
+	return 0;
+}
+
+static int audio_connect(sdr_data_t *sdr, gboolean ci, gboolean co) {
+	// there's nothing to connect, just start reading
+	thread = g_thread_new("file input", file_thread, sdr);
+	return 0;
+}
+
+static int audio_stop(sdr_data_t *sdr) {
+	if (thread) {
+		g_atomic_int_set(&quit, TRUE);
+		g_thread_join(thread);
+		thread = NULL;
+	}
+	if (file) fclose(file);
+	file = NULL;
+	g_free(raw);
+	g_free(left);
+	g_free(right);
+	if (sdr->iqSample) g_free(sdr->iqSample);
+	return 0;
+}
+
+audio_backend_t audio_file = { "file", audio_start, audio_connect, audio_stop };
+
+/* vim: set noexpandtab ai ts=4 sw=4 tw=4: */
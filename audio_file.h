@@ -0,0 +1,39 @@
+/*  lysdr Software Defined Radio
+	(C) 2010-2011 Gordon JC Pearce MM0YEQ and others
+
+	audio_file.h
+
+	This file is part of lysdr.
+
+	lysdr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	any later version.
+
+	lysdr is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with lysdr.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __AUDIO_FILE_H
+#define __AUDIO_FILE_H
+#include "sdr.h"
+#include "audio.h"
+
+enum file_format { FILE_WAV, FILE_S16, FILE_S32, FILE_F32 };
+
+// called after each period with the number of frames that came from the file
+typedef void (*audio_file_output)(sdr_data_t *sdr, gint frames, gpointer data);
+
+extern audio_backend_t audio_file;
+
+gboolean audio_file_setup(const gchar *path, const gchar *format, gint rate, gint period, gboolean realtime);
+void audio_file_run(sdr_data_t *sdr, audio_file_output output, gpointer data);
+
+#endif
+
+/* vim: set noexpandtab ai ts=4 sw=4 tw=4: */
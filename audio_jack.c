@@ -31,47 +31,48 @@ static jack_port_t *I_in;
 static jack_port_t *Q_in;
 static jack_port_t *L_out;
 static jack_port_t *R_out;
+static jack_port_t *rx_out[SDR_MAX_RX];	// one mono port for each receiver after the first
 static jack_client_t *client;
 static jack_status_t status;
 static const char *client_name = "lysdr";
 
 static int audio_process(jack_nframes_t nframes, void *psdr) {
 	// actually kick off processing the samples
-	jack_default_audio_sample_t *ii, *qq, *L, *R;
-	int i, n;
+	jack_default_audio_sample_t *ii, *qq;
+	jack_time_t start = jack_get_time();
+	int n;
 	
 	sdr_data_t *sdr;
 	sdr = (sdr_data_t *) psdr;	// void* cast back to sdr_data_t*
 	
-	// get all four buffers
+	// get the input buffers, and have each receiver write straight into its outputs
 	ii = jack_port_get_buffer (I_in, nframes);
 	qq = jack_port_get_buffer (Q_in, nframes);
-	L = jack_port_get_buffer (L_out, nframes);
-	R = jack_port_get_buffer (R_out, nframes);
+	sdr->rx[0]->sink[0] = jack_port_get_buffer(L_out, nframes);
+	sdr->rx[0]->sink[1] = jack_port_get_buffer(R_out, nframes);
+	for (n = 1; n < sdr->receivers; n++)
+		sdr->rx[n]->sink[0] = jack_port_get_buffer(rx_out[n], nframes);
 
-	// the SDR expects a bunch of complex samples
+	// actually run the SDR for a frame, straight from the port buffers;
+	// it makes them complex itself, with I on the left unless sdr->swap_iq
 
-	for(i = 0; i < nframes; i++) {
-	// uncomment whichever is appropriate
-		sdr->iqSample[i] = ii[i] + I * qq[i]; // I on left
-	//	sdr->iqSample[i] = qq[i] + I * ii[i]; // I on right
-	}
-
-	// actually run the SDR for a frame
+	sdr_process(sdr, ii, qq);
 
-	sdr_process(sdr);
-
-	// copy the frames to the output
-	for(i = 0; i < nframes; i++) {
-		L[i]=sdr->output[i];
-		R[i]=sdr->output[i];
-	}
+	// both times are in microseconds
+	load_record(&sdr->load, jack_get_time() - start, (gint64)nframes * 1000000 / sdr->sample_rate);
 
 	// we're happy, return okay
 	return 0;
 }
 
-int audio_start(sdr_data_t *sdr) {
+static int audio_xrun(void *psdr) {
+	// jack missed a deadline somewhere in the graph, perhaps ours
+	sdr_data_t *sdr = (sdr_data_t *) psdr;
+	load_xrun(&sdr->load);
+	return 0;
+}
+
+static int audio_start(sdr_data_t *sdr) {
 	// open a client connection to the JACK server
 	client = jack_client_open (client_name, JackNullOption, &status, NULL);
 	if (client == NULL) {
@@ -80,7 +81,7 @@ int audio_start(sdr_data_t *sdr) {
 		if (status & JackServerFailed) {
 			fprintf (stderr, "Unable to connect to JACK server\n");
 		}
-		exit (1);
+		return 1;
 	}
 	if (status & JackServerStarted) {
 		fprintf (stderr, "JACK server started\n");
@@ -93,26 +94,27 @@ int audio_start(sdr_data_t *sdr) {
 	// save some info in the SDR
 	sdr->size = jack_get_buffer_size(client);
 	sdr->sample_rate = jack_get_sample_rate(client);
-	sdr->iqSample = g_new0(double complex, sdr->size);
-	sdr->output = g_new0(double, sdr->size);
+	sdr->iqSample = g_new0(sdr_complex_t, sdr->size);
 	return 0;
 }
 
-int audio_stop(sdr_data_t *sdr) {
+static int audio_stop(sdr_data_t *sdr) {
 	// remove the connection to the jack server
 	// we may also want to clean up any audio buffers
 	jack_client_close (client);
 	if (sdr->iqSample) g_free(sdr->iqSample);
-	if (sdr->output) g_free(sdr->output);
 
 	return 0;
 }
 
-int audio_connect(sdr_data_t *sdr, gboolean ci, gboolean co) {
+static int audio_connect(sdr_data_t *sdr, gboolean ci, gboolean co) {
 	
 	const char **ports;
+	char name[32];
+	int i;
 	// start processing audio
 	jack_set_process_callback (client, audio_process, sdr);
+	jack_set_xrun_callback (client, audio_xrun, sdr);
 	//jack_on_shutdown (client, jack_shutdown, 0);
 	
 	I_in = jack_port_register (client, "I input",
@@ -127,11 +129,25 @@ int audio_connect(sdr_data_t *sdr, gboolean ci, gboolean co) {
 	R_out = jack_port_register (client, "R output",
 		JACK_DEFAULT_AUDIO_TYPE,
 		JackPortIsOutput, 0);
+	for (i = 1; i < sdr->receivers; i++) {
+		sprintf(name, "RX%d output", i + 1);
+		rx_out[i] = jack_port_register (client, name,
+			JACK_DEFAULT_AUDIO_TYPE,
+			JackPortIsOutput, 0);
+	}
 	if (jack_activate (client)) {
 		fprintf (stderr, "cannot activate client");
 		exit (1);
 	}
 
+	// the receiver workers have the same deadline as the process callback
+	if (jack_is_realtime(client)) {
+		for (i = 0; i < sdr->nworkers; i++) {
+			if (jack_acquire_real_time_scheduling(sdr->workers[i].thread, jack_client_real_time_priority(client)))
+				fprintf (stderr, "cannot make receiver thread %d realtime\n", i + 1);
+		}
+	}
+
 	if (co) {
 		ports = jack_get_ports (client, NULL, NULL,
 		JackPortIsPhysical|JackPortIsInput);
@@ -168,4 +184,6 @@ int audio_connect(sdr_data_t *sdr, gboolean ci, gboolean co) {
 	return 0;
 }
 
+audio_backend_t audio_jack = { "jack", audio_start, audio_connect, audio_stop };
+
 /* vim: set noexpandtab ai ts=4 sw=4 tw=4: */
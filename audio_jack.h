@@ -22,10 +22,9 @@
 #ifndef __AUDIO_JACK_H
 #define __AUDIO_JACK_H
 #include "sdr.h"
+#include "audio.h"
 
-extern int audio_connect(sdr_data_t *sdr, gboolean ci, gboolean co);
-extern int audio_start(sdr_data_t *sdr);
-extern int audio_stop(sdr_data_t *sdr);
+extern audio_backend_t audio_jack;
 
 #endif
 
@@ -0,0 +1,108 @@
+/*  lysdr Software Defined Radio
+	(C) 2010-2011 Gordon JC Pearce MM0YEQ and others
+
+	batch.c
+	demodulate a whole I/Q file to a WAV file, with no GUI and no JACK
+
+	This file is part of lysdr.
+
+	lysdr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	any later version.
+
+	lysdr is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with lysdr.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+#include <gtk/gtk.h>
+#include "sdr.h"
+#include "audio_file.h"
+#include "batch.h"
+
+typedef struct {
+	FILE *file;
+	gint16 *pcm;		// one period of converted output
+	guint32 frames;		// written so far, for the header
+	gboolean failed;
+} batch_out_t;
+
+static void put16(guchar *p, guint16 v) {
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+static void put32(guchar *p, guint32 v) {
+	put16(p, v);
+	put16(p + 2, v >> 16);
+}
+
+static gboolean wav_header(FILE *f, gint rate, guint32 frames) {
+	// a plain 16 bit mono PCM header, written again with the length at the end
+	guchar h[44];
+
+	memcpy(h, "RIFF", 4);
+	put32(h + 4, 36 + frames * 2);
+	memcpy(h + 8, "WAVEfmt ", 8);
+	put32(h + 16, 16);
+	put16(h + 20, 1);			// PCM
+	put16(h + 22, 1);			// mono
+	put32(h + 24, rate);
+	put32(h + 28, rate * 2);	// bytes per second
+	put16(h + 32, 2);			// bytes per frame
+	put16(h + 34, 16);
+	memcpy(h + 36, "data", 4);
+	put32(h + 40, frames * 2);
+	return fwrite(h, 1, sizeof(h), f) == sizeof(h);
+}
+
+static void batch_output(sdr_data_t *sdr, gint frames, gpointer data) {
+	// the first receiver's audio, clipped to 16 bits
+	batch_out_t *out = (batch_out_t *)data;
+	gfloat *y = sdr->rx[0]->output;
+	gint i;
+
+	for (i = 0; i < frames; i++)
+		out->pcm[i] = GINT16_TO_LE((gint16)lrint(CLAMP(y[i], -1.0, 32767.0 / 32768) * 32768));
+	if (fwrite(out->pcm, 2, frames, out->file) != frames)
+		out->failed = TRUE;
+	out->frames += frames;
+}
+
+gboolean batch_run(sdr_data_t *sdr, const gchar *out_path) {
+	// run the file backend to the end in this thread, saving the audio if there's somewhere to put it
+	batch_out_t out = { NULL, NULL, 0, FALSE };
+
+	if (out_path) {
+		out.file = fopen(out_path, "wb");
+		if (!out.file || !wav_header(out.file, sdr->sample_rate, 0)) {
+			perror(out_path);
+			return FALSE;
+		}
+		out.pcm = g_new(gint16, sdr->size);
+	}
+
+	audio_file_run(sdr, out_path ? batch_output : NULL, &out);
+
+	if (out_path) {
+		rewind(out.file);
+		if (!wav_header(out.file, sdr->sample_rate, out.frames))
+			out.failed = TRUE;
+		if (fclose(out.file))
+			out.failed = TRUE;
+		g_free(out.pcm);
+		if (out.failed)
+			fprintf(stderr, "error writing %s\n", out_path);
+	}
+	return !out.failed;
+}
+
+/* vim: set noexpandtab ai ts=4 sw=4 tw=4: */
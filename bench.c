@@ -0,0 +1,414 @@
+/*  lysdr Software Defined Radio
+	(C) 2010-2011 Gordon JC Pearce MM0YEQ and others
+
+	bench.c
+	time the DSP and drawing hot paths on synthetic input, and print JSON
+
+	This file is part of lysdr.
+
+	lysdr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	any later version.
+
+	lysdr is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with lysdr.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <complex.h>
+#include <gtk/gtk.h>
+
+#include "sdr.h"
+#include "filter.h"
+#include "spectrum.h"
+#include "wisdom.h"
+#include "waterfall.h"
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+#define BENCH_INPUT 65536	// samples of tone plus noise, reused round and round
+#define BENCH_ROWS 40		// waterfall rows a second, as the GUI draws them
+
+static const gint rates[] = { 48000, 96000, 192000 };
+static const gint fir_taps[] = { 32, 64, 128, 256, 512, 1024, 2048 };
+static const gint fir_blocks[] = { 256, 1024, 4096 };
+static const gint fft_sizes[] = { 1024, 4096, 16384 };
+static const gint widths[] = { 1024, 2048, SPECTRUM_MAX_WIDTH };
+
+static gint run_ms = 200;
+static gboolean no_waterfall = FALSE;
+static sdr_complex_t *input;
+static gfloat *input_i, *input_q;	// the same, as two channels of a sound card
+static gboolean first = TRUE;
+
+static GOptionEntry opts[] =
+{
+	{ "time", 't', 0, G_OPTION_ARG_INT, &run_ms, "Milliseconds to run each case (default=200)", "MS" },
+	{ "no-waterfall", 0, 0, G_OPTION_ARG_NONE, &no_waterfall, "Skip the waterfall drawing, which needs a display", NULL },
+	{ NULL }
+};
+
+typedef void (*bench_fn)(gpointer data);
+
+static void bench_input(void) {
+	// a tone at about a seventh of the sample rate, 40dB above white noise
+	guint32 seed = 1;
+	gdouble nr, ni;
+	gint i;
+
+	input = g_new(sdr_complex_t, BENCH_INPUT);
+	input_i = g_new(gfloat, BENCH_INPUT);
+	input_q = g_new(gfloat, BENCH_INPUT);
+	for (i = 0; i < BENCH_INPUT; i++) {
+		seed = seed * 1664525 + 1013904223;
+		nr = seed / 4294967296.0 - 0.5;
+		seed = seed * 1664525 + 1013904223;
+		ni = seed / 4294967296.0 - 0.5;
+		input[i] = 0.5 * cexp(I * 2 * M_PI * 0.1432 * i) + 0.01 * (nr + I * ni);
+		input_i[i] = creal(input[i]);
+		input_q[i] = cimag(input[i]);
+	}
+}
+
+static const sdr_complex_t *bench_block(gint n) {
+	// the next n samples of the input, wrapping round
+	static gint pos = 0;
+	const sdr_complex_t *p;
+
+	if (pos + n > BENCH_INPUT)
+		pos = 0;
+	p = input + pos;
+	pos += n;
+	return p;
+}
+
+static gdouble bench_time(bench_fn fn, gpointer data) {
+	// nanoseconds per call of fn, over about run_ms after a short warm-up
+	gint64 start, now;
+	guint64 calls = 0;
+	gint i;
+
+	for (i = 0; i < 4; i++)
+		fn(data);
+	start = g_get_monotonic_time();
+	do {
+		fn(data);
+		calls++;
+		now = g_get_monotonic_time();
+	} while (now - start < run_ms * 1000);
+	return (now - start) * 1000.0 / calls;
+}
+
+static void bench_result(const gchar *fields, gdouble ns, gdouble per_second) {
+	// one line of the results array; headroom is how many times over the
+	// work would fit in real time, per_second calls a second at each rate
+	// (or per sample, if per_second is 0)
+	gint i;
+	gdouble load;
+
+	printf("%s\n    {%s, \"ns\": %.1f, \"headroom\": {", first ? "" : ",", fields, ns);
+	for (i = 0; i < G_N_ELEMENTS(rates); i++) {
+		load = ns * (per_second ? per_second : rates[i]);
+		printf("%s\"%d\": %.2f", i ? ", " : "", rates[i], 1e9 / load);
+	}
+	printf("}}");
+	first = FALSE;
+}
+
+typedef struct {
+	filter_fir_t *fir;
+	sdr_complex_t *buf;
+} fir_case_t;
+
+static void fir_run(gpointer data) {
+	fir_case_t *c = (fir_case_t *)data;
+
+	memcpy(c->buf, bench_block(c->fir->size), c->fir->size * sizeof(sdr_complex_t));
+	filter_fir_process(c->fir, c->buf);
+}
+
+static void bench_fir(void) {
+	// the channel filter alone, both engines, over tap counts and block sizes
+	static const gchar *engines[] = { NULL, "direct", "fft" };
+	fir_case_t c;
+	gchar *fields;
+	gdouble ns;
+	gint e, t, b;
+
+	for (e = FIR_DIRECT; e <= FIR_FFT; e++) {
+		for (b = 0; b < G_N_ELEMENTS(fir_blocks); b++) {
+			for (t = 0; t < G_N_ELEMENTS(fir_taps); t++) {
+				c.fir = filter_fir_new(fir_taps[t], fir_blocks[b], e);
+				filter_fir_set_response(c.fir, 48000, 3100, 1850);
+				c.buf = g_new(sdr_complex_t, fir_blocks[b]);
+				ns = bench_time(fir_run, &c) / fir_blocks[b];
+				fields = g_strdup_printf("\"bench\": \"fir\", \"engine\": \"%s\", \"taps\": %d, \"block\": %d, \"unit\": \"sample\"",
+					engines[e], fir_taps[t], fir_blocks[b]);
+				bench_result(fields, ns, 0);
+				g_free(fields);
+				g_free(c.buf);
+				filter_fir_destroy(c.fir);
+			}
+		}
+	}
+}
+
+typedef struct {
+	filter_fir_t *fir;
+	filter_hilbert_t *hilbert;	// NULL when the filter picks the sideband
+	sdr_complex_t *buf;
+} sideband_case_t;
+
+static void sideband_filter(sideband_case_t *c) {
+	filter_fir_process(c->fir, c->buf);
+	if (c->hilbert)
+		filter_hilbert_process(c->hilbert, c->buf);
+}
+
+static void sideband_run(gpointer data) {
+	sideband_case_t *c = (sideband_case_t *)data;
+
+	memcpy(c->buf, bench_block(c->fir->size), c->fir->size * sizeof(sdr_complex_t));
+	sideband_filter(c);
+}
+
+static gdouble sideband_power(sideband_case_t *c, gdouble freq) {
+	// mean power of I+Q, as the LSB demodulator takes it, for a tone freq Hz
+	// from the carrier, once the filters have filled
+	gdouble phase = 0, power = 0;
+	gint i, k;
+
+	for (k = 0; k < 16; k++) {
+		for (i = 0; i < c->fir->size; i++) {
+			c->buf[i] = cexp(I * phase);
+			phase += 2 * M_PI * freq / 48000;
+		}
+		sideband_filter(c);
+		if (k >= 8)
+			for (i = 0; i < c->fir->size; i++)
+				power += pow(creal(c->buf[i]) + cimag(c->buf[i]), 2);
+	}
+	return power / (8 * c->fir->size);
+}
+
+static void bench_sideband(void) {
+	// the two ways of picking a sideband: how well each keeps out a tone
+	// 1kHz on the wrong side of the carrier, against what it costs a sample
+	// shaped for 300-3400Hz, as sdr_rx_filter_shape does it
+	static const gint taps[] = { 64, 128, 256, 512 };
+	static const gchar *demods[] = { "fir", "phasing" };
+	sideband_case_t c;
+	gchar *fields;
+	gdouble ns, rejection;
+	gint d, t;
+
+	for (d = SDR_DEMOD_FIR; d <= SDR_DEMOD_PHASING; d++) {
+		for (t = 0; t < G_N_ELEMENTS(taps); t++) {
+			c.fir = filter_fir_new(taps[t], 1024, FIR_AUTO);
+			c.hilbert = NULL;
+			if (d == SDR_DEMOD_PHASING) {
+				c.fir->plain = TRUE;
+				c.hilbert = filter_hilbert_new(1024);
+			}
+			filter_fir_set_response(c.fir, 48000, -3100, 1850);
+			c.buf = g_new(sdr_complex_t, 1024);
+			rejection = 10 * log10(sideband_power(&c, -1000) / sideband_power(&c, 1000));
+			ns = bench_time(sideband_run, &c) / 1024;
+			fields = g_strdup_printf("\"bench\": \"sideband\", \"demod\": \"%s\", \"taps\": %d, \"block\": 1024, \"unit\": \"sample\", \"rejection_db\": %.1f, \"db_per_ns\": %.2f",
+				demods[d], taps[t], rejection, rejection / ns);
+			bench_result(fields, ns, 0);
+			g_free(fields);
+			g_free(c.buf);
+			filter_hilbert_destroy(c.hilbert);
+			filter_fir_destroy(c.fir);
+		}
+	}
+}
+
+static void sdr_run(gpointer data) {
+	sdr_data_t *sdr = (sdr_data_t *)data;
+
+	gint pos = bench_block(sdr->size) - input;
+
+	sdr_process(sdr, input_i + pos, input_q + pos);
+}
+
+static void bench_sdr(void) {
+	// a whole period through sdr_process, as the JACK callback runs it
+	static const gint receivers[] = { 1, 4 };
+	static const gint decimation[] = { 1, 16 };
+	sdr_data_t *sdr;
+	gchar *fields;
+	gdouble ns;
+	gint r, d, i;
+
+	for (r = 0; r < G_N_ELEMENTS(receivers); r++) {
+		for (d = 0; d < G_N_ELEMENTS(decimation); d++) {
+			sdr = sdr_new(1024);
+			sdr->size = 1024;
+			sdr->sample_rate = 192000;
+			sdr->iqSample = g_new0(sdr_complex_t, sdr->size);
+			sdr_decimate_setup(sdr, decimation[d]);
+			for (i = 0; i < receivers[r]; i++) {
+				sdr->rx[i] = sdr_rx_new(sdr, 256, FIR_AUTO);
+				filter_fir_set_response(sdr->rx[i]->filter, sdr->if_rate, 3100, 1850);
+				sdr_rx_tune(sdr->rx[i], sdr->sample_rate, 10000 * (i + 1));
+			}
+			sdr->receivers = receivers[r];
+			sdr_workers_start(sdr);
+			fft_setup(sdr);
+
+			ns = bench_time(sdr_run, sdr) / sdr->size;
+			fields = g_strdup_printf("\"bench\": \"sdr_process\", \"receivers\": %d, \"workers\": %d, \"decimate\": %d, \"taps\": 256, \"block\": %d, \"unit\": \"sample\"",
+				receivers[r], sdr->nworkers, decimation[d], sdr->size);
+			bench_result(fields, ns, 0);
+			g_free(fields);
+
+			sdr_workers_stop(sdr);
+			for (i = 0; i < sdr->receivers; i++)
+				sdr_rx_destroy(sdr, sdr->rx[i]);
+			fft_teardown(sdr);
+			g_free(sdr->iqSample);
+			sdr_destroy(sdr);
+		}
+	}
+}
+
+typedef struct {
+	spectrum_t *spec;
+	guchar *row;
+} spectrum_case_t;
+
+static void spectrum_run(gpointer data) {
+	spectrum_case_t *c = (spectrum_case_t *)data;
+	sdr_data_t *sdr = c->spec->sdr;
+
+	memcpy(sdr->fft->windowed, bench_block(sdr->fft_size), sdr->fft_size * sizeof(sdr_complex_t));
+	spectrum_render(c->spec, c->row);
+}
+
+static void bench_spectrum(void) {
+	// window, FFT and colour map for one waterfall segment; per sample, that's
+	// the cost with 50% overlap and a row for every segment, the most it can be
+	spectrum_case_t c;
+	sdr_data_t *sdr;
+	gchar *fields;
+	gdouble ns;
+	gint f;
+
+	for (f = 0; f < G_N_ELEMENTS(fft_sizes); f++) {
+		sdr = sdr_new(fft_sizes[f]);
+		sdr->size = 1024;
+		sdr->sample_rate = 192000;
+		fft_setup(sdr);
+		c.spec = spectrum_new(sdr, 25, 50, 1, NULL);
+		c.row = g_new(guchar, 4 * fft_sizes[f]);
+
+		ns = bench_time(spectrum_run, &c);
+		fields = g_strdup_printf("\"bench\": \"spectrum\", \"fft_size\": %d, \"width\": %d, \"overlap\": 50, \"segment_ns\": %.1f, \"unit\": \"sample\"",
+			fft_sizes[f], c.spec->width, ns);
+		bench_result(fields, ns / (fft_sizes[f] / 2), 0);
+		g_free(fields);
+
+		spectrum_destroy(c.spec);
+		g_free(c.row);
+		fft_teardown(sdr);
+		sdr_destroy(sdr);
+	}
+}
+
+static void waterfall_run(gpointer data) {
+	static guchar *row = NULL;
+	SDRWaterfall *wf = SDR_WATERFALL(data);
+	gint i;
+
+	if (!row) {
+		row = g_new(guchar, 4 * SPECTRUM_MAX_WIDTH);
+		for (i = 0; i < 4 * SPECTRUM_MAX_WIDTH; i++)
+			row[i] = i * 7;
+	}
+	sdr_waterfall_update(GTK_WIDGET(wf), row, wf->width);
+	gdk_flush();	// count the trip to the X server, not just queueing it
+}
+
+static void bench_waterfall(void) {
+	// blitting a finished row into the waterfall, in a window that's never shown
+	GtkWidget *window;
+	GtkObject *tuning, *lp_tune, *hp_tune;
+	SDRWaterfall *wf;
+	gchar *fields;
+	gdouble ns;
+	gint f;
+
+	for (f = 0; f < G_N_ELEMENTS(widths); f++) {
+		tuning = gtk_adjustment_new(0, -96000, 96000, 1, 0, 0);
+		lp_tune = gtk_adjustment_new(300, 0, 10000, 1, 0, 0);
+		hp_tune = gtk_adjustment_new(3400, 0, 10000, 1, 0, 0);
+		wf = sdr_waterfall_new(GTK_ADJUSTMENT(tuning), GTK_ADJUSTMENT(lp_tune), GTK_ADJUSTMENT(hp_tune), 192000, 4096);
+		gtk_widget_set_size_request(GTK_WIDGET(wf), widths[f], 300);
+		window = gtk_offscreen_window_new();
+		gtk_container_add(GTK_CONTAINER(window), GTK_WIDGET(wf));
+		gtk_widget_show_all(window);
+		while (gtk_events_pending())
+			gtk_main_iteration();
+
+		ns = bench_time(waterfall_run, wf);
+		fields = g_strdup_printf("\"bench\": \"waterfall\", \"width\": %d, \"unit\": \"row\"", wf->width);
+		bench_result(fields, ns, BENCH_ROWS);
+		g_free(fields);
+
+		while (gtk_events_pending())
+			gtk_main_iteration();
+		gtk_widget_destroy(window);
+	}
+}
+
+int main(int argc, char *argv[]) {
+	GError *error = NULL;
+	GOptionContext *context;
+
+	context = g_option_context_new("- time the lysdr hot paths");
+	g_option_context_add_main_entries(context, opts, NULL);
+	g_option_context_add_group(context, gtk_get_option_group(FALSE));
+	if (!g_option_context_parse(context, &argc, &argv, &error)) {
+		g_print("option parsing failed: %s\n", error->message);
+		exit(1);
+	}
+	if (!no_waterfall && !gtk_init_check(&argc, &argv)) {
+		fprintf(stderr, "no display, skipping the waterfall\n");
+		no_waterfall = TRUE;
+	}
+
+#if defined(__SSE__)
+	// as sdr_process does; a filter ringing down into denormals would swamp the timing
+	_mm_setcsr(_mm_getcsr() | 0x8040);
+#endif
+
+	bench_input();
+	printf("{\n  \"precision\": \"%s\",\n  \"processors\": %d,\n  \"rates\": [48000, 96000, 192000],\n  \"results\": [",
+		WISDOM_PRECISION, g_get_num_processors());
+	bench_fir();
+	bench_sideband();
+	bench_sdr();
+	bench_spectrum();
+	if (!no_waterfall)
+		bench_waterfall();
+	printf("\n  ]\n}\n");
+
+	wisdom_save();
+	g_free(input);
+	return 0;
+}
+
+/* vim: set noexpandtab ai ts=4 sw=4 tw=4: */
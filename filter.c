@@ -24,25 +24,54 @@
 */
 
 #include <stdlib.h>
+#include <string.h>
 #include <complex.h>
 #include <math.h>
 #include "filter.h"
 #include "sdr.h"
+#include "wisdom.h"
 #include "hilbert.h"
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FIR_X86
+#endif
+
 #define IS_ALMOST_DENORMAL(f) (fabs(f) < 3.e-34)
 
-static double complex delay[D_SIZE];
+#define HILBERT_HIST (NZEROS - 2)		// inputs before the newest that the taps reach
+#define HILBERT_DELAY (NZEROS / 2 - 1)	// to the middle of the taps
 
-static void make_impulse(double complex fir_imp[], float sample_rate, int taps, float bw, float centre) {
+/* the channel filter is a low-pass prototype shifted up to the middle of
+   the passband.  Only the width and the tap count change the prototype, so
+   the last few are kept, and moving the passband or switching sideband
+   only has to rotate one.  The rotation comes from two tables, for the
+   high and low halves of an integer phase like the receivers' NCOs. */
+
+typedef struct {
+	int taps;		// 0 for an unused slot
+	int sample_rate;
+	float bw;
+	gboolean pinned;	// a preset, never thrown out
+	guint used;		// when it was last wanted, to throw out the oldest
+	double *h;		// the windowed sinc, for k = -taps/2 .. taps/2-1
+} fir_prototype_t;
+
+static fir_prototype_t prototypes[FIR_PROTOTYPES];
+static guint prototype_clock = 0;
+static gint prototypes_pinned = 0;	// never more than FIR_PROTOTYPES-1, so one can always be reused
+static GMutex prototype_lock;	// the designer thread and the GUI can both want one
+static double rot_hi[2 << FIR_ROT_BITS];	// e^(i.phase) for the top bits, as re, im pairs
+static double rot_lo[2 << FIR_ROT_BITS];	// and for the bits below them
+static gboolean rot_ready = FALSE;
+
+static void make_prototype(double h[], float sample_rate, int taps, float bw) {
 
 	float K = bw * taps / sample_rate;
 	float w;
-	double complex z;
+	double z;
 	int k, i=0;
 
-	float tune = 2.0 * M_PI * centre / sample_rate;
-	
 	for (k=-taps/2; k<taps/2; k++) {
 		if (k==0) z=(float)K/taps;
 		else z=1.0/taps*sin(M_PI*k*K/taps)/sin(M_PI*k/taps);
@@ -50,51 +79,510 @@ static void make_impulse(double complex fir_imp[], float sample_rate, int taps,
 		//w = 0.5 + 0.5 * cos(2.0 * M_PI * k / taps); // Hanning window
 		w = 0.42 + 0.5 * cos(2.0f * M_PI * k / taps) + 0.08 * cos(4.0f * M_PI * k / taps); // Blackman window
 		//w=1; // No window
-		z *= w; 
-		z *= 2*cexp(-1*I * tune * k);
-	if (IS_ALMOST_DENORMAL(creal(z))) { z = I * cimag(z); }
-	if (IS_ALMOST_DENORMAL(cimag(z))) { z = creal(z); }
-		fir_imp[i] = z;
+		h[i] = 2 * z * w;
 		i++;
 	}
 }
 
+static void make_rotations(void) {
+	int i, n = 1 << FIR_ROT_BITS;
+	for (i = 0; i < n; i++) {
+		rot_hi[2*i] = cos(2.0 * M_PI * i / n);
+		rot_hi[2*i+1] = sin(2.0 * M_PI * i / n);
+		rot_lo[2*i] = cos(2.0 * M_PI * i / n / n);
+		rot_lo[2*i+1] = sin(2.0 * M_PI * i / n / n);
+	}
+	rot_ready = TRUE;
+}
+
+static fir_prototype_t *fir_prototype(int sample_rate, int taps, float bw) {
+	// find the prototype, or build it in place of the one wanted longest ago
+	// call with prototype_lock held
+	fir_prototype_t *p, *oldest = NULL;
+	int i;
+
+	for (i = 0; i < FIR_PROTOTYPES; i++) {
+		p = &prototypes[i];
+		if (p->taps == taps && p->sample_rate == sample_rate && p->bw == bw) {
+			p->used = ++prototype_clock;
+			return p;
+		}
+		if (!p->pinned && (!oldest || p->used < oldest->used))
+			oldest = p;
+	}
+	p = oldest;		// there's always one, filter_fir_prebuild sees to that
+	if (p->taps != taps) {
+		g_free(p->h);
+		p->h = g_new(double, taps);
+	}
+	p->taps = taps;
+	p->sample_rate = sample_rate;
+	p->bw = bw;
+	p->used = ++prototype_clock;
+	make_prototype(p->h, sample_rate, taps, bw);
+	return p;
+}
+
+static void make_impulse(double complex fir_imp[], float sample_rate, int taps, float bw, float centre) {
+	// the prototype, rotated up to centre; tap k is times e^(-i.tune.k)
+	const int shift = 32 - FIR_ROT_BITS;
+	const guint32 mask = (1 << FIR_ROT_BITS) - 1;
+	guint32 step = (guint32)llround(centre / sample_rate * 4294967296.0);
+	guint32 phase = step * (guint32)(taps / 2);	// for k = -taps/2
+	const double *h, *a, *b;
+	double re, im;
+	double complex z;
+	int i;
+
+	g_mutex_lock(&prototype_lock);
+	if (!rot_ready) make_rotations();
+	h = fir_prototype(sample_rate, taps, bw)->h;
+	for (i = 0; i < taps; i++) {
+		a = rot_hi + 2 * (phase >> shift);
+		b = rot_lo + 2 * ((phase >> (shift - FIR_ROT_BITS)) & mask);
+		re = h[i] * (a[0] * b[0] - a[1] * b[1]);
+		im = h[i] * (a[0] * b[1] + a[1] * b[0]);
+		phase -= step;
+		if (IS_ALMOST_DENORMAL(re)) re = 0;
+		if (IS_ALMOST_DENORMAL(im)) im = 0;
+		z = re + I * im;
+		fir_imp[i] = z;
+	}
+	g_mutex_unlock(&prototype_lock);
+}
+
+void filter_fir_prebuild(filter_fir_t *filter, int sample_rate, float bw) {
+	// keep the prototype for a filter this wide to hand for good, for presets;
+	// once all but one slot are pinned, the rest are only cached like any other
+	fir_prototype_t *p;
+
+	g_mutex_lock(&prototype_lock);
+	p = fir_prototype(sample_rate, filter->taps, bw);
+	if (!p->pinned && prototypes_pinned < FIR_PROTOTYPES - 1) {
+		p->pinned = TRUE;
+		prototypes_pinned++;
+	}
+	g_mutex_unlock(&prototype_lock);
+}
+
+
+/* direct form kernels
+   coef and x are interleaved I/Q pairs, so I lands in the even lanes and Q
+   in the odd lanes and each output is one straight multiply-accumulate over
+   2*taps values.  The window for output k starts at x + 2*k, which lets
+   FIR_BLOCK outputs share every load of the coefficients. */
+
+typedef void (*fir_kernel_t)(const sdr_real_t *coef, const sdr_real_t *x, int taps, int nout, sdr_complex_t *out);
+
+static void fir_kernel_scalar(const sdr_real_t *coef, const sdr_real_t *x, int taps, int nout, sdr_complex_t *out) {
+	int j, k;
+	sdr_real_t accI, accQ;
+	for (k = 0; k < nout; k++) {
+		accI = accQ = 0;
+		for (j = 0; j < 2 * taps; j += 2) {
+			accI += x[j] * coef[j];
+			accQ += x[j + 1] * coef[j + 1];
+		}
+		out[k] = accI + I * accQ;
+		x += 2;
+	}
+}
+
+#if defined(FIR_X86) && !defined(SDR_SINGLE)
+static void fir_kernel_sse2(const double *coef, const double *x, int taps, int nout, double complex *out) {
+	int j, k;
+	__m128d c, a0, a1, a2, a3;
+
+	if (nout == FIR_BLOCK) {
+		a0 = a1 = a2 = a3 = _mm_setzero_pd();
+		for (j = 0; j < 2 * taps; j += 2) {
+			c = _mm_loadu_pd(coef + j);
+			a0 = _mm_add_pd(a0, _mm_mul_pd(_mm_loadu_pd(x + j), c));
+			a1 = _mm_add_pd(a1, _mm_mul_pd(_mm_loadu_pd(x + j + 2), c));
+			a2 = _mm_add_pd(a2, _mm_mul_pd(_mm_loadu_pd(x + j + 4), c));
+			a3 = _mm_add_pd(a3, _mm_mul_pd(_mm_loadu_pd(x + j + 6), c));
+		}
+		_mm_storeu_pd((double *)&out[0], a0);
+		_mm_storeu_pd((double *)&out[1], a1);
+		_mm_storeu_pd((double *)&out[2], a2);
+		_mm_storeu_pd((double *)&out[3], a3);
+		return;
+	}
+	for (k = 0; k < nout; k++) {
+		// two accumulators to hide the add latency
+		a0 = a1 = _mm_setzero_pd();
+		for (j = 0; j < 2 * taps; j += 4) {
+			a0 = _mm_add_pd(a0, _mm_mul_pd(_mm_loadu_pd(x + j), _mm_loadu_pd(coef + j)));
+			a1 = _mm_add_pd(a1, _mm_mul_pd(_mm_loadu_pd(x + j + 2), _mm_loadu_pd(coef + j + 2)));
+		}
+		_mm_storeu_pd((double *)&out[k], _mm_add_pd(a0, a1));
+		x += 2;
+	}
+}
+
+__attribute__((target("avx2,fma")))
+static inline __m128d fir_fold_avx(__m256d a) {
+	// [I0 Q0 I1 Q1] -> [I0+I1 Q0+Q1]
+	return _mm_add_pd(_mm256_castpd256_pd128(a), _mm256_extractf128_pd(a, 1));
+}
+
+__attribute__((target("avx2,fma")))
+static void fir_kernel_avx2(const double *coef, const double *x, int taps, int nout, double complex *out) {
+	int j, k;
+	__m256d c, a0, a1, a2, a3;
+
+	if (nout == FIR_BLOCK) {
+		a0 = a1 = a2 = a3 = _mm256_setzero_pd();
+		for (j = 0; j < 2 * taps; j += 4) {
+			c = _mm256_loadu_pd(coef + j);
+			a0 = _mm256_fmadd_pd(_mm256_loadu_pd(x + j), c, a0);
+			a1 = _mm256_fmadd_pd(_mm256_loadu_pd(x + j + 2), c, a1);
+			a2 = _mm256_fmadd_pd(_mm256_loadu_pd(x + j + 4), c, a2);
+			a3 = _mm256_fmadd_pd(_mm256_loadu_pd(x + j + 6), c, a3);
+		}
+		_mm_storeu_pd((double *)&out[0], fir_fold_avx(a0));
+		_mm_storeu_pd((double *)&out[1], fir_fold_avx(a1));
+		_mm_storeu_pd((double *)&out[2], fir_fold_avx(a2));
+		_mm_storeu_pd((double *)&out[3], fir_fold_avx(a3));
+		return;
+	}
+	for (k = 0; k < nout; k++) {
+		a0 = a1 = _mm256_setzero_pd();
+		for (j = 0; j < 2 * taps; j += 8) {
+			a0 = _mm256_fmadd_pd(_mm256_loadu_pd(x + j), _mm256_loadu_pd(coef + j), a0);
+			a1 = _mm256_fmadd_pd(_mm256_loadu_pd(x + j + 4), _mm256_loadu_pd(coef + j + 4), a1);
+		}
+		_mm_storeu_pd((double *)&out[k], fir_fold_avx(_mm256_add_pd(a0, a1)));
+		x += 2;
+	}
+}
+#endif
+
+#if defined(FIR_X86) && defined(SDR_SINGLE)
+static inline void fir_store_sse(float complex *out, __m128 a) {
+	// [I0 Q0 I1 Q1] -> [I0+I1 Q0+Q1]
+	_mm_storel_pi((__m64 *)out, _mm_add_ps(a, _mm_movehl_ps(a, a)));
+}
+
+static void fir_kernel_sse2(const float *coef, const float *x, int taps, int nout, float complex *out) {
+	int j, k;
+	__m128 c, a0, a1, a2, a3;
+
+	if (nout == FIR_BLOCK) {
+		a0 = a1 = a2 = a3 = _mm_setzero_ps();
+		for (j = 0; j < 2 * taps; j += 4) {
+			c = _mm_loadu_ps(coef + j);
+			a0 = _mm_add_ps(a0, _mm_mul_ps(_mm_loadu_ps(x + j), c));
+			a1 = _mm_add_ps(a1, _mm_mul_ps(_mm_loadu_ps(x + j + 2), c));
+			a2 = _mm_add_ps(a2, _mm_mul_ps(_mm_loadu_ps(x + j + 4), c));
+			a3 = _mm_add_ps(a3, _mm_mul_ps(_mm_loadu_ps(x + j + 6), c));
+		}
+		fir_store_sse(&out[0], a0);
+		fir_store_sse(&out[1], a1);
+		fir_store_sse(&out[2], a2);
+		fir_store_sse(&out[3], a3);
+		return;
+	}
+	for (k = 0; k < nout; k++) {
+		a0 = a1 = _mm_setzero_ps();
+		for (j = 0; j < 2 * taps; j += 8) {
+			a0 = _mm_add_ps(a0, _mm_mul_ps(_mm_loadu_ps(x + j), _mm_loadu_ps(coef + j)));
+			a1 = _mm_add_ps(a1, _mm_mul_ps(_mm_loadu_ps(x + j + 4), _mm_loadu_ps(coef + j + 4)));
+		}
+		fir_store_sse(&out[k], _mm_add_ps(a0, a1));
+		x += 2;
+	}
+}
+
+__attribute__((target("avx2,fma")))
+static inline void fir_store_avx(float complex *out, __m256 a) {
+	__m128 b = _mm_add_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+	_mm_storel_pi((__m64 *)out, _mm_add_ps(b, _mm_movehl_ps(b, b)));
+}
+
+__attribute__((target("avx2,fma")))
+static void fir_kernel_avx2(const float *coef, const float *x, int taps, int nout, float complex *out) {
+	int j, k;
+	__m256 c, a0, a1, a2, a3;
 
-filter_fir_t *filter_fir_new(int taps, int size) {
+	if (nout == FIR_BLOCK) {
+		a0 = a1 = a2 = a3 = _mm256_setzero_ps();
+		for (j = 0; j < 2 * taps; j += 8) {
+			c = _mm256_loadu_ps(coef + j);
+			a0 = _mm256_fmadd_ps(_mm256_loadu_ps(x + j), c, a0);
+			a1 = _mm256_fmadd_ps(_mm256_loadu_ps(x + j + 2), c, a1);
+			a2 = _mm256_fmadd_ps(_mm256_loadu_ps(x + j + 4), c, a2);
+			a3 = _mm256_fmadd_ps(_mm256_loadu_ps(x + j + 6), c, a3);
+		}
+		fir_store_avx(&out[0], a0);
+		fir_store_avx(&out[1], a1);
+		fir_store_avx(&out[2], a2);
+		fir_store_avx(&out[3], a3);
+		return;
+	}
+	for (k = 0; k < nout; k++) {
+		a0 = a1 = _mm256_setzero_ps();
+		for (j = 0; j < 2 * taps; j += 16) {
+			a0 = _mm256_fmadd_ps(_mm256_loadu_ps(x + j), _mm256_loadu_ps(coef + j), a0);
+			a1 = _mm256_fmadd_ps(_mm256_loadu_ps(x + j + 8), _mm256_loadu_ps(coef + j + 8), a1);
+		}
+		fir_store_avx(&out[k], _mm256_add_ps(a0, a1));
+		x += 2;
+	}
+}
+#endif
+
+static fir_kernel_t fir_kernel = NULL;
+
+static void fir_pick_kernel(void) {
+	// choose the widest kernel this CPU can run
+	fir_kernel = fir_kernel_scalar;
+#ifdef FIR_X86
+	fir_kernel = fir_kernel_sse2;
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		fir_kernel = fir_kernel_avx2;
+#endif
+}
+
+static void fir_ols_new(filter_fir_t *filter) {
+	// set up the buffers and plans for overlap-save fast convolution
+	// each period is one partition, so there is no extra latency
+	int n = 2 * filter->size;
+	int b;
+	filter->parts = (filter->taps + filter->size - 1) / filter->size;
+	filter->fdl_pos = 0;
+	filter->ols_in = FFTW(malloc)(sizeof(FFTW(complex)) * n);
+	filter->ols_out = FFTW(malloc)(sizeof(FFTW(complex)) * n);
+	filter->ols_acc = FFTW(malloc)(sizeof(FFTW(complex)) * n);
+	filter->fdl = FFTW(malloc)(sizeof(FFTW(complex)) * 2 * n * filter->parts);
+	memset(filter->ols_in, 0, sizeof(FFTW(complex)) * n);
+	memset(filter->fdl, 0, sizeof(FFTW(complex)) * 2 * n * filter->parts);
+	for (b = 0; b < 2; b++) {
+		filter->bank[b].resp_A = FFTW(malloc)(sizeof(FFTW(complex)) * n * filter->parts);
+		filter->bank[b].resp_B = FFTW(malloc)(sizeof(FFTW(complex)) * n * filter->parts);
+		memset(filter->bank[b].resp_A, 0, sizeof(FFTW(complex)) * n * filter->parts);
+		memset(filter->bank[b].resp_B, 0, sizeof(FFTW(complex)) * n * filter->parts);
+	}
+	filter->fwd = wisdom_plan(n, filter->ols_in, filter->fdl, FFTW_FORWARD);
+	filter->inv = wisdom_plan(n, filter->ols_acc, filter->ols_out, FFTW_BACKWARD);
+}
+
+static void fir_ols_destroy(filter_fir_t *filter) {
+	int b;
+	FFTW(destroy_plan)(filter->fwd);
+	FFTW(destroy_plan)(filter->inv);
+	FFTW(free)(filter->ols_in);
+	FFTW(free)(filter->ols_out);
+	FFTW(free)(filter->ols_acc);
+	FFTW(free)(filter->fdl);
+	for (b = 0; b < 2; b++) {
+		FFTW(free)(filter->bank[b].resp_A);
+		FFTW(free)(filter->bank[b].resp_B);
+	}
+}
+
+filter_fir_t *filter_fir_new(int taps, int size, gint engine) {
 	// create the structure for a new FIR filter
 	filter_fir_t *filter = malloc(sizeof(filter_fir_t));
+	int b;
 	filter->taps = taps;
 	filter->size = size;
-	filter->impulse = malloc(sizeof(double complex)*taps);
-	filter->imp_I = malloc(sizeof(double)*taps);
-	filter->imp_Q = malloc(sizeof(double)*taps);
-	filter->buf_I = malloc(sizeof(double)*taps);
-	filter->buf_Q = malloc(sizeof(double)*taps);
+	filter->impulse = calloc(taps, sizeof(double complex));
+	filter->imp_I = calloc(taps, sizeof(double));
+	filter->imp_Q = calloc(taps, sizeof(double));
+	filter->padded = (taps + FIR_ALIGN - 1) / FIR_ALIGN * FIR_ALIGN;
+	filter->ring = filter->padded + FIR_BLOCK - 1;
+	for (b = 0; b < 2; b++) {
+		filter->bank[b].coef = FFTW(malloc)(sizeof(sdr_real_t) * 2 * filter->padded);
+		memset(filter->bank[b].coef, 0, sizeof(sdr_real_t) * 2 * filter->padded);
+		filter->bank[b].resp_A = filter->bank[b].resp_B = NULL;
+	}
+	filter->live = 0;
+	filter->swap = FIR_SWAP_IDLE;
+	filter->design_serial = 0;
+	filter->crossfade = TRUE;
+	filter->plain = FALSE;
+	filter->fade = FFTW(malloc)(sizeof(sdr_complex_t) * size);
+	filter->delay = FFTW(malloc)(sizeof(sdr_real_t) * 4 * filter->ring);
+	memset(filter->delay, 0, sizeof(sdr_real_t) * 4 * filter->ring);
 	filter->index = 0;
+	if (!fir_kernel) fir_pick_kernel();
+
+	if (engine == FIR_AUTO)
+		engine = (taps > FIR_FFT_MIN_TAPS) ? FIR_FFT : FIR_DIRECT;
+	filter->engine = engine;
+	if (engine == FIR_FFT)
+		fir_ols_new(filter);
 	return filter;
 }
 
 void filter_fir_destroy(filter_fir_t *filter) {
 	// destroy the FIR filter
 	if (filter) {
+		if (filter->engine == FIR_FFT) fir_ols_destroy(filter);
 		if (filter->impulse) free(filter->impulse);
 		if (filter->imp_I) free(filter->imp_I);
 		if (filter->imp_Q) free(filter->imp_Q);
-		if (filter->buf_I) free(filter->buf_I);
-		if (filter->buf_Q) free(filter->buf_Q);
+		FFTW(free)(filter->bank[0].coef);
+		FFTW(free)(filter->bank[1].coef);
+		if (filter->fade) FFTW(free)(filter->fade);
+		if (filter->delay) FFTW(free)(filter->delay);
 	   free(filter);
 	}
 }
 
-void filter_fir_set_response(filter_fir_t *filter, int sample_rate, float bw, float centre) {
-	// plop an impulse into the appropriate array
-	int i;
+static void fir_ols_set_response(filter_fir_t *filter, filter_bank_t *bank) {
+	// transform each partition of the impulse into the frequency domain
+	// the direct filter runs I through imp_I and Q through imp_Q separately,
+	// so with X the spectrum of I+jQ the output spectrum is
+	// Y[k] = A[k].X[k] + B[k].conj(X[-k])  where A=(HI+HQ)/2, B=(HI-HQ)/2
+	int size = filter->size;
+	int n = 2 * size;
+	int i, j, k, m;
+	double complex hi, hq;
+	sdr_complex_t *z = FFTW(malloc)(sizeof(FFTW(complex)) * n);
+	sdr_complex_t *Z = FFTW(malloc)(sizeof(FFTW(complex)) * n);
+
+	for (k = 0; k < filter->parts; k++) {
+		for (i = 0; i < n; i++) {
+			// filter_fir_process pairs imp[0] with the newest sample and imp[j]
+			// with the sample taps-j old; lay the taps out by delay to match
+			m = k * size + i;
+			if (i >= size || m >= filter->taps) z[i] = 0;
+			else if (m == 0) z[i] = filter->imp_I[0] + I * filter->imp_Q[0];
+			else z[i] = filter->imp_I[filter->taps - m] + I * filter->imp_Q[filter->taps - m];
+		}
+		FFTW(execute_dft)(filter->fwd, z, Z);
+		for (i = 0; i < n; i++) {
+			j = (n - i) % n;
+			hi = (Z[i] + conj(Z[j])) / 2;		// spectrum of the real taps
+			hq = (Z[i] - conj(Z[j])) / (2 * I);	// spectrum of the imaginary taps
+			// fold in the 1/n that fftw leaves out of the inverse transform
+			bank->resp_A[k * n + i] = (hi + hq) / (2 * n);
+			bank->resp_B[k * n + i] = (hi - hq) / (2 * n);
+		}
+	}
+	FFTW(free)(z);
+	FFTW(free)(Z);
+}
+
+static void fir_design(filter_fir_t *filter, filter_bank_t *bank, int sample_rate, float bw, float centre) {
+	// plop an impulse into a bank
+	int i, j;
+	int taps = filter->taps;
+	int pad = filter->padded - taps;
 	make_impulse(filter->impulse, sample_rate, filter->taps, bw, centre);
 
 	for (i=0; i<filter->taps; i++) {
 		filter->imp_I[i] = creal(filter->impulse[i]);
 		filter->imp_Q[i] = cimag(filter->impulse[i]);
+		if (filter->plain)	// the real part alone; a band-pass each side of DC, at half gain
+			filter->imp_Q[i] = filter->imp_I[i];
 	} 
+
+	// the direct kernel walks the window oldest first, and imp[0] belongs
+	// with the newest sample, so the taps go in rotated by one
+	for (i=0; i<taps; i++) {
+		j = (i + 1) % taps;
+		bank->coef[2 * (pad + i)] = filter->imp_I[j];
+		bank->coef[2 * (pad + i) + 1] = filter->imp_Q[j];
+	}
+	if (filter->engine == FIR_FFT)
+		fir_ols_set_response(filter, bank);
+}
+
+void filter_fir_set_response(filter_fir_t *filter, int sample_rate, float bw, float centre) {
+	// change the response straight away, in this thread; only for while
+	// nothing is running the filter, use filter_fir_design once it is
+	fir_design(filter, &filter->bank[filter->live], sample_rate, bw, centre);
+	filter->swap = FIR_SWAP_IDLE;
+}
+
+/* the designer thread
+   Moving a filter edge builds a whole new set of taps, which can't be done
+   in place while the audio thread is reading them.  Requests queue up for
+   a thread that builds each into the filter's spare bank and marks it
+   ready; the audio thread changes over at the start of a period, at the
+   cost of one atomic operation.  Requests overtaken by a later one for the
+   same filter are dropped, so dragging an edge only builds what's needed. */
+
+typedef struct {
+	filter_fir_t *filter;	// NULL tells the designer to stop
+	gint serial;
+	int sample_rate;
+	float bw, centre;
+} fir_request_t;
+
+static GThread *designer = NULL;
+static GAsyncQueue *requests = NULL;
+
+static gboolean fir_claim_spare(filter_fir_t *filter) {
+	// make sure the audio thread isn't going to read the spare bank
+	// a bank that's built but not yet taken up can be taken back and built again
+	for (;;) {
+		if (g_atomic_int_compare_and_exchange(&filter->swap, FIR_SWAP_READY, FIR_SWAP_IDLE))
+			return TRUE;
+		if (g_atomic_int_get(&filter->swap) == FIR_SWAP_IDLE)
+			return TRUE;
+		// changing over, which only lasts for the rest of a period
+		g_usleep(FIR_DESIGN_WAIT);
+	}
+}
+
+static gpointer fir_designer_thread(gpointer data) {
+	fir_request_t *req;
+	filter_fir_t *filter;
+
+	for (;;) {
+		req = g_async_queue_pop(requests);
+		filter = req->filter;
+		if (!filter) {
+			g_free(req);
+			break;
+		}
+		if (req->serial == g_atomic_int_get(&filter->design_serial) && fir_claim_spare(filter)) {
+			fir_design(filter, &filter->bank[!filter->live], req->sample_rate, req->bw, req->centre);
+			g_atomic_int_set(&filter->swap, FIR_SWAP_READY);
+		}
+		g_free(req);
+	}
+	return NULL;
+}
+
+void filter_designer_start(void) {
+	requests = g_async_queue_new();
+	designer = g_thread_new("filter designer", fir_designer_thread, NULL);
+}
+
+void filter_designer_stop(void) {
+	// finish what's queued, then stop; do this before destroying any filters
+	if (!designer)
+		return;
+	g_async_queue_push(requests, g_new0(fir_request_t, 1));
+	g_thread_join(designer);
+	g_async_queue_unref(requests);
+	designer = NULL;
+	requests = NULL;
+}
+
+void filter_fir_design(filter_fir_t *filter, int sample_rate, float bw, float centre) {
+	// change the response of a running filter, without holding up whatever's running it
+	// without a designer thread, this is just filter_fir_set_response
+	fir_request_t *req;
+
+	if (!designer) {
+		filter_fir_set_response(filter, sample_rate, bw, centre);
+		return;
+	}
+	req = g_new(fir_request_t, 1);
+	req->filter = filter;
+	g_atomic_int_inc(&filter->design_serial);
+	req->serial = g_atomic_int_get(&filter->design_serial);
+	req->sample_rate = sample_rate;
+	req->bw = bw;
+	req->centre = centre;
+	g_async_queue_push(requests, req);
 }
 
 void filter_iir_set_response(filter_iir_t *filter, int sample_rate, float cutoff, float q) {
@@ -120,57 +608,310 @@ void filter_iir_set_response(filter_iir_t *filter, int sample_rate, float cutoff
 	*/
 }
 
-void filter_fir_process(filter_fir_t *filter, double complex *samples) {
+static void fir_ols_output(filter_fir_t *filter, filter_bank_t *bank, sdr_complex_t *out) {
+	// apply a bank's response to the spectra in the delay line, and transform back
+	int size = filter->size;
+	int n = 2 * size;
+	int parts = filter->parts;
+	int i, k, slot;
+	sdr_real_t *X, *Xr, *A, *B;
+	sdr_real_t *acc = (sdr_real_t *)filter->ols_acc;
+
+	memset(acc, 0, sizeof(sdr_complex_t) * n);
+	slot = filter->fdl_pos;
+	for (k = 0; k < parts; k++) {
+		// acc += A.X + B.conj(X[-k]), written out in real arithmetic so
+		// the compiler doesn't drop into the C99 inf/nan handling
+		X = (sdr_real_t *)(filter->fdl + slot * 2 * n);
+		Xr = X + 2 * n;
+		A = (sdr_real_t *)(bank->resp_A + k * n);
+		B = (sdr_real_t *)(bank->resp_B + k * n);
+		for (i = 0; i < 2 * n; i += 2) {
+			acc[i] += A[i] * X[i] - A[i+1] * X[i+1] + B[i] * Xr[i] - B[i+1] * Xr[i+1];
+			acc[i+1] += A[i] * X[i+1] + A[i+1] * X[i] + B[i] * Xr[i+1] + B[i+1] * Xr[i];
+		}
+		if (++slot >= parts) slot = 0;
+	}
+	FFTW(execute)(filter->inv);
+
+	// only the second half is free of circular wraparound
+	memcpy(out, filter->ols_out + size, sizeof(sdr_complex_t) * size);
+}
+
+static void fir_ols_process(filter_fir_t *filter, filter_bank_t *bank, filter_bank_t *old, sdr_complex_t *samples) {
+	// overlap-save: costs two FFTs plus one multiply-add per bin for each
+	// partition, rather than one multiply-add per tap for each sample
+	// old, if set, is also run into filter->fade, for the crossfade
+	int size = filter->size;
+	int n = 2 * size;
+	int parts = filter->parts;
+	int i, j;
+	sdr_real_t *X;
+
+	// slide the input window along by one block
+	memcpy(filter->ols_in, filter->ols_in + size, sizeof(sdr_complex_t) * size);
+	memcpy(filter->ols_in + size, samples, sizeof(sdr_complex_t) * size);
+
+	// the newest spectrum goes at fdl_pos, older ones follow it.  Each slot
+	// holds X followed by conj(X[-k]) so the sum below runs straight through
+	if (--filter->fdl_pos < 0) filter->fdl_pos = parts - 1;
+	X = (sdr_real_t *)(filter->fdl + filter->fdl_pos * 2 * n);
+	FFTW(execute_dft)(filter->fwd, filter->ols_in, (FFTW(complex) *)X);
+	for (i = 0; i < n; i++) {
+		j = (i == 0) ? 0 : n - i;
+		X[2 * (n + i)] = X[2 * j];
+		X[2 * (n + i) + 1] = -X[2 * j + 1];
+	}
+
+	if (old)
+		fir_ols_output(filter, old, filter->fade);
+	fir_ols_output(filter, bank, samples);
+}
+
+static void fir_crossfade(filter_fir_t *filter, sdr_complex_t *samples) {
+	// go linearly from the old bank's output, in filter->fade, to the new one's
+	int i;
+	sdr_real_t step = 1.0 / filter->size;
+	sdr_real_t *x = (sdr_real_t *)samples, *f = (sdr_real_t *)filter->fade;
+
+	for (i = 0; i < filter->size; i++) {
+		x[2*i] = f[2*i] + (x[2*i] - f[2*i]) * ((i + 1) * step);
+		x[2*i+1] = f[2*i+1] + (x[2*i+1] - f[2*i+1]) * ((i + 1) * step);
+	}
+}
+
+void filter_fir_process(filter_fir_t *filter, sdr_complex_t *samples) {
 	// Perform an FIR filter on the data "in place"
-	// this routine is slow and has a horrible hack to avoid denormals
-	int i, j, k;
-	double complex c;
-	double accI, accQ;
-	double *buf_I = filter->buf_I;
-	double *buf_Q = filter->buf_Q;
-	double *imp_I = filter->imp_I;
-	double *imp_Q = filter->imp_Q;
+	// denormals are flushed by the FPU, see sdr_process()
+	int i, k, n;
 	int index = filter->index;
-	int taps = filter->taps;
-		
-	for (i = 0; i < filter->size; i++) {
-		c = samples[i];
-		buf_I[index] = creal(c);
-		buf_Q[index] = cimag(c);
-		// flush denormals
-		if (IS_ALMOST_DENORMAL(buf_I[index])) { buf_I[index]=0; }
-		if (IS_ALMOST_DENORMAL(buf_Q[index])) { buf_Q[index]=0; }
-		accI = accQ = 0;
-		j = index;
-		for (k = 0; k < taps; k++) {
-			accI += buf_I[j] * imp_I[k];
-			accQ += buf_Q[j] * imp_Q[k];
-			if (++j >= taps) j = 0;
+	int ring = filter->ring;
+	int padded = filter->padded;
+	sdr_real_t *delay = filter->delay;
+	filter_bank_t *bank, *old = NULL;
+	gboolean swapping = FALSE;
+
+	// change over to a new response at the start of a period if one's ready
+	if (g_atomic_int_get(&filter->swap) == FIR_SWAP_READY &&
+			g_atomic_int_compare_and_exchange(&filter->swap, FIR_SWAP_READY, FIR_SWAP_BUSY)) {
+		swapping = TRUE;
+		if (filter->crossfade)
+			old = &filter->bank[filter->live];
+		filter->live = !filter->live;
+	}
+	bank = &filter->bank[filter->live];
+
+	if (filter->engine == FIR_FFT) {
+		fir_ols_process(filter, bank, old, samples);
+		if (old)
+			fir_crossfade(filter, samples);
+		if (swapping)
+			g_atomic_int_set(&filter->swap, FIR_SWAP_IDLE);
+		return;
+	}
+
+	for (i = 0; i < filter->size; i += n) {
+		// take up to FIR_BLOCK samples, but never across the end of the ring
+		// so that their windows stay side by side
+		n = MIN(FIR_BLOCK, MIN(filter->size - i, ring - index));
+		for (k = 0; k < n; k++) {
+			delay[2 * (index + k)] = delay[2 * (index + k + ring)] = creal(samples[i + k]);
+			delay[2 * (index + k) + 1] = delay[2 * (index + k + ring) + 1] = cimag(samples[i + k]);
 		}
-		samples[i] = accI + I * accQ;
-		index++;
-		if (index >= taps) index = 0;
+		// the window for the sample at index ends at index+ring in the upper copy
+		if (old)
+			fir_kernel(old->coef, delay + 2 * (index + ring - padded + 1), padded, n, filter->fade + i);
+		fir_kernel(bank->coef, delay + 2 * (index + ring - padded + 1), padded, n, samples + i);
+		index += n;
+		if (index >= ring) index = 0;
 	}
 	filter->index = index;
+	if (old)
+		fir_crossfade(filter, samples);
+	if (swapping)
+		g_atomic_int_set(&filter->swap, FIR_SWAP_IDLE);
 }
 
-void filter_hilbert(gint phase, double complex *samples, gint taps) {
-	// Hilbert transform, shamelessly nicked from swh-plugins
-	// taps needs to be a multiple of D_SIZE
-	// returns I and Q, with Q rotated through 90 degrees
-	// 100 samples delay
-	gint i, j, dptr = 0;
-	gfloat hilb;
-	for (i = 0; i < taps; i++) {
-	  delay[dptr] = samples[i];
-	  hilb = 0.0f;
-	  for (j = 0; j < NZEROS/2; j++) {
-	    hilb += (phase*xcoeffs[j] * cimag(delay[(dptr - j*2) & (D_SIZE - 1)]));
-	  }
-	  samples[i] = creal(delay[(dptr-99)& (D_SIZE-1)]) + I * hilb;
-	  dptr = (dptr + 1) & (D_SIZE - 1);
+filter_hilbert_t *filter_hilbert_new(int size) {
+	// a Hilbert transformer with the taps from Steve Harris' swh-plugins, for
+	// blocks of size samples; it keeps its own history, so it runs on unbroken
+	filter_hilbert_t *hilbert = malloc(sizeof(filter_hilbert_t));
+	double gain = 0;
+	int j;
+
+	hilbert->size = size;
+	hilbert->taps = NZEROS / 2;
+	hilbert->coef = malloc(sizeof(sdr_real_t) * hilbert->taps);
+	// those taps have a gain of about pi/2; make it 1 at a quarter of the
+	// sample rate, where each tap is a half turn on from the last, and turn
+	// them round so that each mode gets the same sideband as from the channel filter
+	for (j = 0; j < hilbert->taps; j++)
+		gain += (j & 1) ? -xcoeffs[j] : xcoeffs[j];
+	for (j = 0; j < hilbert->taps; j++)
+		hilbert->coef[j] = -xcoeffs[j] / fabs(gain);
+	hilbert->hist_I = calloc(HILBERT_HIST + size, sizeof(sdr_real_t));
+	hilbert->hist_Q = calloc(HILBERT_HIST + size, sizeof(sdr_real_t));
+	return hilbert;
+}
+
+void filter_hilbert_destroy(filter_hilbert_t *hilbert) {
+	if (hilbert) {
+		free(hilbert->coef);
+		free(hilbert->hist_I);
+		free(hilbert->hist_Q);
+		free(hilbert);
 	}
+}
+
+void filter_hilbert_process(filter_hilbert_t *hilbert, sdr_complex_t *samples) {
+	// phasing: replace each sample with I, delayed to the middle of the
+	// transformer, plus j times the transform of Q, in place; I+Q of the
+	// result is then one sideband and I-Q the other
+	// the taps are spread two samples apart, so a vector of consecutive
+	// outputs takes each tap times a vector of consecutive inputs
+	int n, j, size = hilbert->size, taps = hilbert->taps;
+	const sdr_real_t *coef = hilbert->coef;
+	sdr_real_t *in_I = hilbert->hist_I + HILBERT_HIST;
+	sdr_real_t *in_Q = hilbert->hist_Q + HILBERT_HIST;
+	sdr_real_t *x, acc, *out = (sdr_real_t *)samples;
+#if defined(FIR_X86) && defined(SDR_SINGLE)
+	__m128 c, a[4], d;
+#elif defined(FIR_X86)
+	__m128d c, a[4], d;
+#endif
+	int v;
 
+	for (n = 0; n < size; n++) {
+		in_I[n] = creal(samples[n]);
+		in_Q[n] = cimag(samples[n]);
+	}
+
+	n = 0;
+#if defined(FIR_X86) && defined(SDR_SINGLE)
+	// four vectors of outputs at once, so the adds don't wait on each other
+	for (; n + 16 <= size; n += 16) {
+		a[0] = a[1] = a[2] = a[3] = _mm_setzero_ps();
+		for (j = 0; j < taps; j++) {
+			x = in_Q + n - 2 * j;
+			c = _mm_set1_ps(coef[j]);
+			a[0] = _mm_add_ps(a[0], _mm_mul_ps(c, _mm_loadu_ps(x)));
+			a[1] = _mm_add_ps(a[1], _mm_mul_ps(c, _mm_loadu_ps(x + 4)));
+			a[2] = _mm_add_ps(a[2], _mm_mul_ps(c, _mm_loadu_ps(x + 8)));
+			a[3] = _mm_add_ps(a[3], _mm_mul_ps(c, _mm_loadu_ps(x + 12)));
+		}
+		// interleave with the delayed I to make complex samples again
+		for (v = 0; v < 4; v++) {
+			d = _mm_loadu_ps(in_I + n + 4 * v - HILBERT_DELAY);
+			_mm_storeu_ps(out + 2 * n + 8 * v, _mm_unpacklo_ps(d, a[v]));
+			_mm_storeu_ps(out + 2 * n + 8 * v + 4, _mm_unpackhi_ps(d, a[v]));
+		}
+	}
+#elif defined(FIR_X86)
+	for (; n + 8 <= size; n += 8) {
+		a[0] = a[1] = a[2] = a[3] = _mm_setzero_pd();
+		for (j = 0; j < taps; j++) {
+			x = in_Q + n - 2 * j;
+			c = _mm_set1_pd(coef[j]);
+			a[0] = _mm_add_pd(a[0], _mm_mul_pd(c, _mm_loadu_pd(x)));
+			a[1] = _mm_add_pd(a[1], _mm_mul_pd(c, _mm_loadu_pd(x + 2)));
+			a[2] = _mm_add_pd(a[2], _mm_mul_pd(c, _mm_loadu_pd(x + 4)));
+			a[3] = _mm_add_pd(a[3], _mm_mul_pd(c, _mm_loadu_pd(x + 6)));
+		}
+		for (v = 0; v < 4; v++) {
+			d = _mm_loadu_pd(in_I + n + 2 * v - HILBERT_DELAY);
+			_mm_storeu_pd(out + 2 * n + 4 * v, _mm_unpacklo_pd(d, a[v]));
+			_mm_storeu_pd(out + 2 * n + 4 * v + 2, _mm_unpackhi_pd(d, a[v]));
+		}
+	}
+#endif
+	for (; n < size; n++) {
+		acc = 0;
+		x = in_Q + n;
+		for (j = 0; j < taps; j++)
+			acc += coef[j] * x[-2 * j];
+		out[2 * n] = in_I[n - HILBERT_DELAY];
+		out[2 * n + 1] = acc;
+	}
+
+	memmove(hilbert->hist_I, hilbert->hist_I + size, sizeof(sdr_real_t) * HILBERT_HIST);
+	memmove(hilbert->hist_Q, hilbert->hist_Q + size, sizeof(sdr_real_t) * HILBERT_HIST);
+}
+
+filter_hb_t *filter_hb_new(int taps, int size, gboolean interpolate) {
+	// windowed-sinc half-band, flat enough in the passband that the cascade
+	// needs no compensation, unlike a CIC
+	filter_hb_t *hb = malloc(sizeof(filter_hb_t));
+	int k = (taps + 1) / 4;
+	int j, o;
+	double w, sum = 0;
+
+	hb->taps = 4 * k - 1;
+	hb->size = size;
+	hb->coef = malloc(sizeof(sdr_real_t) * k);
+	for (j = 0; j < k; j++) {
+		o = 2 * j + 1;	// only the odd offsets from the centre are non-zero
+		w = 0.42 + 0.5 * cos(2.0 * M_PI * o / (hb->taps + 1)) + 0.08 * cos(4.0 * M_PI * o / (hb->taps + 1)); // Blackman window
+		hb->coef[j] = w * sin(M_PI * o / 2) / (M_PI * o);
+		sum += hb->coef[j];
+	}
+	// normalise so that each side sums to 1/4 and the DC gain is exactly 1
+	for (j = 0; j < k; j++)
+		hb->coef[j] *= 0.25 / sum;
+
+	hb->hist = NULL;
+	hb->rhist = NULL;
+	if (interpolate)
+		hb->rhist = calloc(hb->taps + size, sizeof(sdr_real_t));
+	else
+		hb->hist = calloc(hb->taps - 1 + size, sizeof(sdr_complex_t));
+	return hb;
+}
+
+void filter_hb_destroy(filter_hb_t *hb) {
+	if (hb) {
+		if (hb->coef) free(hb->coef);
+		if (hb->hist) free(hb->hist);
+		if (hb->rhist) free(hb->rhist);
+		free(hb);
+	}
+}
+
+void filter_hb_decimate(filter_hb_t *hb, sdr_complex_t *in, sdr_complex_t *out) {
+	// filter and keep every other sample, hb->size in and hb->size/2 out
+	// out may be the same buffer as in
+	int i, j;
+	int k = (hb->taps + 1) / 4;
+	int c = (hb->taps - 1) / 2;
+	sdr_complex_t *x, acc;
+
+	memcpy(hb->hist + hb->taps - 1, in, sizeof(sdr_complex_t) * hb->size);
+	for (i = 0; i < hb->size / 2; i++) {
+		x = hb->hist + 2 * i + c;	// the centre tap for this output
+		acc = 0.5 * x[0];
+		for (j = 0; j < k; j++)
+			acc += hb->coef[j] * (x[-2 * j - 1] + x[2 * j + 1]);
+		out[i] = acc;
+	}
+	memmove(hb->hist, hb->hist + hb->size, sizeof(sdr_complex_t) * (hb->taps - 1));
+}
+
+void filter_hb_interpolate(filter_hb_t *hb, sdr_real_t *in, sdr_real_t *out) {
+	// insert a zero between samples and filter, hb->size in and 2*hb->size out
+	// the odd outputs only see the centre tap, so they're just delayed input
+	int i, j;
+	int k = (hb->taps + 1) / 4;
+	sdr_real_t *x, acc;
+
+	memcpy(hb->rhist + hb->taps, in, sizeof(sdr_real_t) * hb->size);
+	for (i = 0; i < hb->size; i++) {
+		x = hb->rhist + hb->taps + i - k;
+		acc = 0;
+		for (j = 0; j < k; j++)
+			acc += hb->coef[j] * (x[-j] + x[j + 1]);
+		out[2 * i] = 2 * acc;
+		out[2 * i + 1] = x[1];
+	}
+	memmove(hb->rhist, hb->rhist + hb->size, sizeof(sdr_real_t) * hb->taps);
 }
 
 void filter_iir_process(filter_iir_t *filter, gfloat *samples) {
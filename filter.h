@@ -37,22 +37,100 @@ typedef struct {
     
 
 // FIR filter defs
+#define FIR_FFT_MIN_TAPS 128	// above this many taps, FIR_AUTO uses fast convolution
+#define FIR_BLOCK 4		// output samples computed per pass of the direct kernel
+#define FIR_ALIGN 8		// direct form taps are padded to a multiple of this
+
+enum fir_engine { FIR_AUTO, FIR_DIRECT, FIR_FFT };
+
+#define FIR_DESIGN_WAIT 200	// microseconds the designer sleeps while a bank is in use
+#define FIR_PROTOTYPES 16	// low-pass prototypes kept, for re-centring
+#define FIR_ROT_BITS 12		// the rotation tables cover twice this many bits of phase
+
+enum fir_swap { FIR_SWAP_IDLE, FIR_SWAP_READY, FIR_SWAP_BUSY };
+
+// one set of coefficients, in the form the engine runs
 typedef struct {
-	double complex *impulse;
-	double *buf_I;
-	double *buf_Q;
+	sdr_real_t *coef;		// FIR_DIRECT: interleaved I/Q taps, oldest first
+	FFTW(complex) *resp_A;	// FIR_FFT: response applied to X[k], per partition
+	FFTW(complex) *resp_B;	// FIR_FFT: response applied to conj(X[-k]), per partition
+} filter_bank_t;
+
+typedef struct {
+	double complex *impulse;	// the designer's working space
 	double *imp_I;
 	double *imp_Q;
-	int index;
+
+	// two banks: the process thread runs bank[live], the designer thread fills
+	// the other, and swap tells the process thread to change over at the start
+	// of its next period, fading from the old response to the new over it
+	filter_bank_t bank[2];
+	gint live;
+	volatile gint swap;		// FIR_SWAP_READY when the spare bank is built, BUSY while changing over
+	volatile gint design_serial;	// bumped by each filter_fir_design, so only the latest is built
+	gboolean crossfade;
+	gboolean plain;		// run I and Q through the same real taps, for the phasing demodulator
+	sdr_complex_t *fade;	// the old bank's output while fading
+
+	// direct form: a delay line stored twice over so that every window
+	// of taps is contiguous
+	sdr_real_t *delay;
+	int index;		// next write position in the delay line
+	int ring;		// length of one copy of the delay line
+	int padded;		// taps rounded up to a multiple of FIR_ALIGN
+
 	int size;
 	int taps;
+	gint engine;		// FIR_DIRECT or FIR_FFT, never FIR_AUTO once created
+
+	// uniformly-partitioned overlap-save, used by FIR_FFT
+	// the impulse is cut into "parts" partitions of "size" taps, each
+	// convolved in the frequency domain with a 2*size point FFT
+	int parts;
+	int fdl_pos;		// which slot of the delay line holds the newest spectrum
+	FFTW(complex) *ols_in;	// previous and current input block
+	FFTW(complex) *ols_out;
+	FFTW(complex) *ols_acc;	// accumulated output spectrum
+	FFTW(complex) *fdl;		// frequency-domain delay line, parts pairs of spectra
+	FFTW(plan) fwd;
+	FFTW(plan) inv;
 } filter_fir_t;
 
-filter_fir_t *filter_fir_new(int taps, int size);
+// half-band filter defs, for decimating or interpolating by two
+// taps is 4k-1: the centre tap is 1/2 and every other tap is zero
+typedef struct {
+	int taps;
+	int size;		// input samples per call
+	sdr_real_t *coef;	// the k non-zero taps either side of the centre, innermost first
+	sdr_complex_t *hist;	// decimator: taps-1 samples of history then the block
+	sdr_real_t *rhist;	// interpolator: taps samples of history then the block
+} filter_hb_t;
+
+// Hilbert transformer for the phasing demodulator; every other tap is zero,
+// so only the odd offsets from the centre are kept
+typedef struct {
+	int size;		// samples per call
+	int taps;		// the non-zero ones
+	sdr_real_t *coef;	// newest sample's first
+	sdr_real_t *hist_I;	// history then the block, for I...
+	sdr_real_t *hist_Q;	// ...and for Q, which is what's transformed
+} filter_hilbert_t;
+
+filter_fir_t *filter_fir_new(int taps, int size, gint engine);
 void filter_fir_destroy(filter_fir_t *filter);
 void filter_fir_set_response(filter_fir_t *filter, int sample_rate, float bw, float centre);
-void filter_fir_process(filter_fir_t *filter, double complex *samples);
-void filter_hilbert(gint phase, double complex *samples, gint taps);
+void filter_fir_design(filter_fir_t *filter, int sample_rate, float bw, float centre);
+void filter_fir_prebuild(filter_fir_t *filter, int sample_rate, float bw);
+void filter_designer_start(void);
+void filter_designer_stop(void);
+void filter_fir_process(filter_fir_t *filter, sdr_complex_t *samples);
+filter_hilbert_t *filter_hilbert_new(int size);
+void filter_hilbert_destroy(filter_hilbert_t *hilbert);
+void filter_hilbert_process(filter_hilbert_t *hilbert, sdr_complex_t *samples);
+filter_hb_t *filter_hb_new(int taps, int size, gboolean interpolate);
+void filter_hb_destroy(filter_hb_t *hb);
+void filter_hb_decimate(filter_hb_t *hb, sdr_complex_t *in, sdr_complex_t *out);
+void filter_hb_interpolate(filter_hb_t *hb, sdr_real_t *in, sdr_real_t *out);
 #endif
 
 /* vim: set noexpandtab ai ts=4 sw=4 tw=4: */
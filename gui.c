@@ -27,7 +27,7 @@
 #include "sdr.h"
 #include "waterfall.h"
 #include "smeter.h"
-#include "colourmap.h"
+#include "spectrum.h"
 
 extern sdr_data_t *sdr;
 
@@ -35,61 +35,149 @@ extern sdr_data_t *sdr;
 static GtkWidget *label;
 static SDRWaterfall *wfdisplay;
 static GtkWidget *meter;
+static spectrum_t *spectrum;
+static GtkWidget *mode_combo;
+static GtkWidget *agc_combo;
+static GtkWidget *status;
+static load_snapshot_t load_last;	// the counts as of the last status bar update
+static gint history_level = 0;		// pyramid level on show when looking back
+static guint64 history_back = 0;	// rows of that level newer than the newest on show
+static gboolean history_shown = FALSE;	// the waterfall is showing history rather than live rows
+
+#define GUI_RETRY 10	// ms between attempts to send changes that are held back
+
+// the latest change of each kind asked of each receiver, whether it's been
+// sent to the audio thread yet, and where the last one sent is in the queue
+static struct {
+	gdouble value;
+	gboolean held;	// not sent yet
+	gint sent;		// cmd_head just after the last one went
+} gui_cmd[SDR_MAX_RX][SDR_CMD_TYPES];
+static guint gui_retry_source = 0;
+
+// the filter dropdown; lowpass is the edge further from the carrier, as on the sliders
+static const struct {
+	const gchar *name;
+	gdouble lowpass, highpass;
+} filter_presets[] = {
+	{ "Wide", 3400, 300 },
+	{ "Narrow", 1500, 500 },
+};
+
+static void gui_update_markers(sdr_data_t *sdr) {
+	// keep the waterfall's receiver markers in step with the receivers
+	gdouble tuning[SDR_MAX_RX];
+	int i;
+	if (sdr->receivers < 2) return;
+	for (i = 0; i < sdr->receivers; i++)
+		tuning[i] = sdr->rx[i]->tuning;
+	sdr_waterfall_set_markers(wfdisplay, tuning, sdr->receivers, sdr->active);
+}
 
-static gboolean gui_update_waterfall(GtkWidget *widget) {
+static void gui_history_span(GString *s, gdouble seconds) {
+	if (seconds < 120) g_string_append_printf(s, "%.0f s", seconds);
+	else if (seconds < 7200) g_string_append_printf(s, "%.0f min", seconds / 60);
+	else g_string_append_printf(s, "%.1f h", seconds / 3600);
+}
 
-	int i, j, p, hi;
-	gdouble y;
-	
-	gdouble wi, wq;
-	
-	fftw_complex z;
-	guchar data[sdr->fft_size*4];
-	static gfloat oldy[8192];
-	gfloat filt = 0.5;
-	gint32 colour;
-	fft_data_t *fft= sdr->fft;
-
-	// copy the block of samples to a buffer
-	// we can then apply a window function to it
-	memmove(fft->windowed, fft->samples, sizeof(double complex)*(sdr->fft_size));
-
-	// window it
-	for (i=0; i<sdr->fft_size; i++) {
-		// Hamming function
-		wi = 0.54 - 0.46 * cos(2.0 * M_PI * i/sdr->fft_size);
-		// Blackman function, better strong-signal performance but more computationally expensive
-		//wi = 0.42 - 0.5 * cos(2.0f * M_PI * i / sdr->fft_size) + 0.08 * cos(4.0f * M_PI * i / sdr->fft_size);
-		fft->windowed[i] *= wi + I * wi;
+static void gui_history_draw(void) {
+	// fill the waterfall from the history file, oldest row first as if it were live
+	history_t *hist = spectrum->history;
+	SDRWaterfall *wf = wfdisplay;
+	guint ctx = gtk_statusbar_get_context_id(GTK_STATUSBAR(status), "history");
+	guchar *row = g_new(guchar, 4 * wf->width);
+	const guchar *q;
+	gint64 newest = 0, oldest = 0, t;
+	GDateTime *when;
+	GString *s;
+	gchar *date;
+	gint i;
+
+	for (i = wf->wf_height - 1; i >= 0; i--) {
+		q = history_get(hist, history_level, history_back + i, &t);
+		if (q) {
+			spectrum_history_row(spectrum, q, hist->bins, row, wf->width, wf->zoom, wf->view_centre);
+			if (!oldest) oldest = t;
+			newest = t;
+		} else
+			memset(row, 0, 4 * wf->width);
+		sdr_waterfall_update(GTK_WIDGET(wf), row, wf->width);
 	}
-	
-	fftw_execute(fft->plan);
-	fft->status=EMPTY;
-	fft->index=0;
+	g_free(row);
+
+	gtk_statusbar_pop(GTK_STATUSBAR(status), ctx);
+	if (!history_shown)
+		return;
+	s = g_string_new("History to ");
+	when = g_date_time_new_from_unix_local(newest / G_USEC_PER_SEC);
+	date = g_date_time_format(when, "%Y-%m-%d %H:%M:%S");
+	g_string_append(s, date);
+	g_string_append(s, ", ");
+	gui_history_span(s, (newest - oldest) / 1e6);
+	g_string_append_printf(s, " on screen (level %d)", history_level);
+	gtk_statusbar_push(GTK_STATUSBAR(status), ctx, s->str);
+	g_free(date);
+	g_date_time_unref(when);
+	g_string_free(s, TRUE);
+}
 
-	hi = sdr->fft_size/2;
-	j=0;
-	
-	for(i=0; i<sdr->fft_size; i++) {
-		p=i;
-		if (p<hi) p=p+hi; else p=p-hi;
-		z = fft->out[p];	 // contains the FFT data 
-		y=10*cabs(z);
-		y = (y*filt) + (oldy[i]*(1-filt));
-		oldy[i]=y;
-		y = CLAMP(y , 0, 1.0);
-		colour = colourmap[(int)(255*y)];
-		data[j++] = (colour>>8)&0xff;
-		data[j++] = (colour>>16)&0xff;
-		data[j++] = colour>>24;
-		data[j++] = 255;			
-	} 
+static gboolean gui_history_scroll(GtkWidget *widget, GdkEventScroll *event, gpointer data) {
+	// alt-scroll looks back through the history, alt-ctrl-scroll zooms out in time;
+	// anything else is for the waterfall itself
+	SDRWaterfall *wf = SDR_WATERFALL(widget);
+	history_t *hist = spectrum->history;
+	guint64 step = MAX(wf->wf_height / 4, 1);
+
+	if (!hist || !(event->state & GDK_MOD1_MASK))
+		return FALSE;
+
+	if (event->state & GDK_CONTROL_MASK) {
+		// keep the newest row on show about the same time ago
+		if (event->direction == GDK_SCROLL_UP && history_level < HISTORY_LEVELS - 1) {
+			history_level++;
+			history_back /= HISTORY_FACTOR;
+		} else if (event->direction == GDK_SCROLL_DOWN && history_level > 0) {
+			history_level--;
+			history_back *= HISTORY_FACTOR;
+		}
+	} else {
+		if (event->direction == GDK_SCROLL_UP)
+			history_back += step;
+		else if (event->direction == GDK_SCROLL_DOWN)
+			history_back = history_back > step ? history_back - step : 0;
+	}
+	history_back = MIN(history_back, MAX(history_length(hist, history_level), 1) - 1);
 
-	
+	// back at the newest full-resolution row, the live waterfall carries on from the history
+	history_shown = history_level || history_back;
+	gui_history_draw();
+	return TRUE;
+}
 
-	sdr_waterfall_update(widget, data);
+static gboolean gui_update_waterfall(GtkWidget *widget) {
+	// blit whatever the spectrum thread has finished since last time
+	static gint view_serial = 0;
+	SDRWaterfall *wf = SDR_WATERFALL(widget);
+	guchar *row;
+	gint width;
+	gdouble y;
+
+	if (view_serial != wf->view_serial) {
+		// zoomed, panned or resized; have the spectrum thread draw rows to fit
+		view_serial = wf->view_serial;
+		spectrum_set_view(spectrum, wf->width, wf->zoom, wf->view_centre);
+		if (history_shown)
+			gui_history_draw();
+	}
 
-	y = (2000-sdr->agc_gain)/2000;
+	while ((row = spectrum_get_row(spectrum, &width))) {
+		if (!history_shown)
+			sdr_waterfall_update(widget, row, width);
+		spectrum_release_row(spectrum, row);
+	}
+
+
+	y = (2000-sdr->rx[sdr->active]->agc_gain)/2000;
 	if (y<0) y = 0;
 	if (y>1) y = 1;
 	y=y*y;
@@ -97,13 +185,102 @@ static gboolean gui_update_waterfall(GtkWidget *widget) {
 	return TRUE;
 }
 
+static gboolean gui_update_load(gpointer psdr) {
+	// DSP load over the last second, and any xruns
+	sdr_data_t *sdr = (sdr_data_t *) psdr;
+	load_snapshot_t now;
+	load_summary_t sum;
+	guint ctx = gtk_statusbar_get_context_id(GTK_STATUSBAR(status), "load");
+	gchar *s;
+
+	load_snapshot(&sdr->load, &now);
+	load_summarise(&now, &load_last, &sum);
+	load_last = now;
+
+	// the bar shows the newest message, so leave the history's up while it's on show
+	gtk_statusbar_pop(GTK_STATUSBAR(status), ctx);
+	if (history_shown)
+		return TRUE;
+	if (!sum.periods)
+		s = g_strdup_printf("DSP idle, %d xruns", now.xruns);
+	else
+		s = g_strdup_printf("DSP load min %.1f%%  avg %.1f%%  p99 %.1f%%  max %.1f%%  -  %d xruns",
+			sum.min, sum.avg, sum.p99, sum.max, now.xruns);
+	gtk_statusbar_push(GTK_STATUSBAR(status), ctx, s);
+	g_free(s);
+	return TRUE;
+}
+
+static gboolean gui_queued(sdr_data_t *sdr, gint rx, gint type) {
+	// the last change of this kind sent to rx is still waiting in the queue
+	return (gint)((guint)g_atomic_int_get(&sdr->cmd_tail) - (guint)gui_cmd[rx][type].sent) < 0;
+}
+
+static gboolean gui_send(sdr_data_t *sdr, gint rx, gint type, gdouble value) {
+	// send a change unless the last of its kind is still queued, in which case
+	// the two would be taken in the same period and only the later one matter
+	if (gui_queued(sdr, rx, type))
+		return FALSE;
+	if (!sdr_command(sdr, type, rx, value, 0))
+		return FALSE;
+	gui_cmd[rx][type].sent = sdr->cmd_head;	// only this thread moves the head
+	return TRUE;
+}
+
+static gboolean gui_retry(gpointer psdr) {
+	// send what's held back, until there's nothing left
+	sdr_data_t *sdr = (sdr_data_t *) psdr;
+	gboolean waiting = FALSE;
+	gint rx, type;
+
+	for (rx = 0; rx < SDR_MAX_RX; rx++)
+		for (type = 0; type < SDR_CMD_TYPES; type++) {
+			if (!gui_cmd[rx][type].held)
+				continue;
+			if (gui_send(sdr, rx, type, gui_cmd[rx][type].value))
+				gui_cmd[rx][type].held = FALSE;
+			else
+				waiting = TRUE;
+		}
+	if (!waiting)
+		gui_retry_source = 0;
+	return waiting;
+}
+
+static void gui_command(sdr_data_t *sdr, gint type, gdouble value) {
+	// change the active receiver; if the queue is full, or a change of the same
+	// kind hasn't been taken yet, hold on to this one, replacing any held before,
+	// and have gui_retry send it when it can, so only the latest is ever lost
+	gint rx = sdr->active;
+
+	gui_cmd[rx][type].value = value;
+	if (!gui_cmd[rx][type].held && gui_send(sdr, rx, type, value))
+		return;
+	gui_cmd[rx][type].held = TRUE;
+	if (!gui_retry_source)
+		gui_retry_source = g_timeout_add(GUI_RETRY, gui_retry, sdr);
+}
+
+static gdouble gui_setting(sdr_data_t *sdr, gint type, gdouble current) {
+	// what the active receiver's setting will be, once the changes it's been
+	// asked for are made; current is what it is now
+	gint rx = sdr->active;
+	if (gui_cmd[rx][type].held || gui_queued(sdr, rx, type))
+		return gui_cmd[rx][type].value;
+	return current;
+}
+
 static void tuning_changed(GtkWidget *widget, gpointer psdr) {
 	sdr_data_t *sdr;
+	sdr_rx_t *rx;
 	char l[256];
 	sdr = (sdr_data_t *) psdr;
+	rx = sdr->rx[sdr->active];
 	float tune = gtk_adjustment_get_value(GTK_ADJUSTMENT(widget));
 
-	sdr->loPhase = cexp((I * -2.0 * 3.14159 * tune) / sdr->sample_rate);
+	gui_command(sdr, SDR_CMD_TUNE, tune);
+	rx->tuning = tune;
+	gui_update_markers(sdr);
 	sprintf(l, "<span size=\"large\">%4.5f</span>",(sdr->centre_freq/1000000.0f)+(tune/1000000));
 	gtk_label_set_markup(GTK_LABEL(label), l);
 }
@@ -111,23 +288,23 @@ static void tuning_changed(GtkWidget *widget, gpointer psdr) {
 static void filter_clicked(GtkWidget *widget, gpointer psdr) {
 	sdr_data_t *sdr = (sdr_data_t *) psdr;
 	gint state = gtk_combo_box_get_active(GTK_COMBO_BOX(widget));
-	switch (state) {
-		case 0:
-			sdr_waterfall_set_lowpass(wfdisplay, 3400.0f);
-			sdr_waterfall_set_highpass(wfdisplay, 300.0f);
-			break;
-		case 1:
-			sdr_waterfall_set_lowpass(wfdisplay, 1500.0f);
-			sdr_waterfall_set_highpass(wfdisplay, 500.0f);
-			break;
-	}
+	if (state < 0 || state >= G_N_ELEMENTS(filter_presets))
+		return;
+	sdr_waterfall_set_lowpass(wfdisplay, filter_presets[state].lowpass);
+	sdr_waterfall_set_highpass(wfdisplay, filter_presets[state].highpass);
 }
 
 static void filter_changed(GtkWidget *widget, gpointer psdr) {
 	sdr_data_t *sdr = (sdr_data_t *) psdr;
+	sdr_rx_t *rx = sdr->rx[sdr->active];
 	gdouble lowpass = gtk_adjustment_get_value(GTK_ADJUSTMENT(sdr->lp_tune));
 	gdouble highpass = gtk_adjustment_get_value(GTK_ADJUSTMENT(sdr->hp_tune));
-	filter_fir_set_response(sdr->filter, sdr->sample_rate, highpass-lowpass, lowpass+(highpass-lowpass)/2);
+	gfloat bw, centre;
+	rx->lowpass = lowpass;
+	rx->highpass = highpass;
+	// built on the designer thread, and taken up by the receiver at the start of a period
+	sdr_rx_filter_shape(rx, lowpass, highpass, &bw, &centre);
+	filter_fir_design(rx->filter, sdr->if_rate, bw, centre);
 }
 
 static void mode_changed(GtkWidget *widget, gpointer psdr) {
@@ -135,11 +312,11 @@ static void mode_changed(GtkWidget *widget, gpointer psdr) {
 	gint state = gtk_combo_box_get_active(GTK_COMBO_BOX(widget));
 	switch(state) {
 		case SDR_LSB:
-		 sdr->mode = SDR_LSB;
+		 gui_command(sdr, SDR_CMD_MODE, SDR_LSB);
 		 SDR_WATERFALL(wfdisplay)->mode = SDR_LSB;
 		 break;
 		case SDR_USB:
-		 sdr->mode = SDR_USB;
+		 gui_command(sdr, SDR_CMD_MODE, SDR_USB);
 		 SDR_WATERFALL(wfdisplay)->mode = SDR_USB;
 			break;
 	}
@@ -152,18 +329,51 @@ static void agc_changed(GtkWidget *widget, gpointer psdr) {
 	gint state = gtk_combo_box_get_active(GTK_COMBO_BOX(widget));
 	switch (state) {
 		case 0:
-			sdr->agc_speed = 0.005;
+			gui_command(sdr, SDR_CMD_AGC, 0.005);
 			break;
 		case 1:
-			sdr->agc_speed = 0.001;
+			gui_command(sdr, SDR_CMD_AGC, 0.001);
 			break;
 		case 2:
-			sdr->agc_speed = -1.0;
+			gui_command(sdr, SDR_CMD_AGC, -1.0);
 			break;
 	}
 }
 
-void gui_display(sdr_data_t *sdr, gboolean horizontal)
+static void window_changed(GtkWidget *widget, gpointer pspec) {
+	spectrum_t *spec = (spectrum_t *) pspec;
+	spectrum_set_window(spec, gtk_combo_box_get_active(GTK_COMBO_BOX(widget)), spec->want_beta);
+}
+
+static void rx_changed(GtkWidget *widget, gpointer psdr) {
+	// point the controls at another receiver, and load its settings into them
+	sdr_data_t *sdr = (sdr_data_t *) psdr;
+	sdr_rx_t *rx;
+	gdouble lowpass, highpass, agc_speed;
+
+	sdr->active = gtk_combo_box_get_active(GTK_COMBO_BOX(widget));
+	rx = sdr->rx[sdr->active];
+
+	// filter_changed will overwrite these as the adjustments move
+	lowpass = rx->lowpass;
+	highpass = rx->highpass;
+	// the filter edges limit each other, so move the one that won't get stuck first
+	if (lowpass < gtk_adjustment_get_value(GTK_ADJUSTMENT(sdr->hp_tune))) {
+		sdr_waterfall_set_highpass(wfdisplay, highpass);
+		sdr_waterfall_set_lowpass(wfdisplay, lowpass);
+	} else {
+		sdr_waterfall_set_lowpass(wfdisplay, lowpass);
+		sdr_waterfall_set_highpass(wfdisplay, highpass);
+	}
+	// the receiver may not have made the last changes sent to it yet
+	gtk_combo_box_set_active(GTK_COMBO_BOX(mode_combo), (gint)gui_setting(sdr, SDR_CMD_MODE, rx->mode));
+	agc_speed = gui_setting(sdr, SDR_CMD_AGC, rx->agc_speed);
+	gtk_combo_box_set_active(GTK_COMBO_BOX(agc_combo), agc_speed < 0 ? 2 : agc_speed < 0.005 ? 1 : 0);
+	gtk_adjustment_set_value(GTK_ADJUSTMENT(sdr->tuning), rx->tuning);
+	gui_update_markers(sdr);
+}
+
+void gui_display(sdr_data_t *sdr, spectrum_t *spec, gboolean horizontal)
 {
 	GtkWidget *mainWindow = gtk_window_new(GTK_WINDOW_TOPLEVEL);
 	GtkWidget *waterfall;
@@ -173,10 +383,15 @@ void gui_display(sdr_data_t *sdr, gboolean horizontal)
 	GtkWidget *lpslider;
 	GtkWidget *hpslider;
 	GtkWidget *filter_combo;
-	GtkWidget *mode_combo;
-	GtkWidget *agc_combo;
+	GtkWidget *rx_combo = NULL;
+	GtkWidget *window_combo;
 	
 	float tune_max;
+	int i, j;
+	char s[16];
+	gfloat bw, centre;
+
+	spectrum = spec;
 	
 	gtk_window_set_title(GTK_WINDOW(mainWindow), "lysdr");
 	gtk_signal_connect(GTK_OBJECT(mainWindow), "destroy", G_CALLBACK(gtk_main_quit), NULL);
@@ -205,14 +420,31 @@ void gui_display(sdr_data_t *sdr, gboolean horizontal)
 	gtk_combo_box_set_active(GTK_COMBO_BOX(agc_combo), 0);
 	gtk_box_pack_start(GTK_BOX(hbox), agc_combo, TRUE, TRUE, 0);
 
+	// receiver selector, only if there's more than one
+	if (sdr->receivers > 1) {
+		rx_combo = gtk_combo_box_new_text();
+		for (i = 0; i < sdr->receivers; i++) {
+			sprintf(s, "RX%d", i + 1);
+			gtk_combo_box_append_text(GTK_COMBO_BOX(rx_combo), s);
+		}
+		gtk_combo_box_set_active(GTK_COMBO_BOX(rx_combo), 0);
+		gtk_box_pack_start(GTK_BOX(hbox), rx_combo, TRUE, TRUE, 0);
+	}
+
 	// VFO readout
 	label = gtk_label_new (NULL);
 	gtk_box_pack_start(GTK_BOX(hbox), label, TRUE, TRUE, 0);
 	gtk_label_set_markup(GTK_LABEL(label), "<tt>VFO</tt>");
 
 	filter_combo = gtk_combo_box_new_text();
-	gtk_combo_box_append_text(GTK_COMBO_BOX(filter_combo), "Wide");
-	gtk_combo_box_append_text(GTK_COMBO_BOX(filter_combo), "Narrow");
+	for (j = 0; j < G_N_ELEMENTS(filter_presets); j++) {
+		gtk_combo_box_append_text(GTK_COMBO_BOX(filter_combo), filter_presets[j].name);
+		// the widths filter_changed will ask for, so picking a preset only has to rotate them
+		for (i = 0; i < sdr->receivers; i++) {
+			sdr_rx_filter_shape(sdr->rx[i], filter_presets[j].lowpass, filter_presets[j].highpass, &bw, &centre);
+			filter_fir_prebuild(sdr->rx[i]->filter, sdr->if_rate, bw);
+		}
+	}
 	gtk_combo_box_set_active(GTK_COMBO_BOX(filter_combo), 0);
 	gtk_box_pack_start(GTK_BOX(hbox), filter_combo, TRUE, TRUE, 0);
 
@@ -222,6 +454,16 @@ void gui_display(sdr_data_t *sdr, gboolean horizontal)
 	gtk_combo_box_set_active(GTK_COMBO_BOX(mode_combo), 0);
 	gtk_box_pack_start(GTK_BOX(hbox), mode_combo, TRUE, TRUE, 0);
 
+	// waterfall window, in enum spectrum_window order
+	window_combo = gtk_combo_box_new_text();
+	gtk_combo_box_append_text(GTK_COMBO_BOX(window_combo), "Hann");
+	gtk_combo_box_append_text(GTK_COMBO_BOX(window_combo), "Hamming");
+	gtk_combo_box_append_text(GTK_COMBO_BOX(window_combo), "Blackman-Harris");
+	gtk_combo_box_append_text(GTK_COMBO_BOX(window_combo), "Flat top");
+	gtk_combo_box_append_text(GTK_COMBO_BOX(window_combo), "Kaiser");
+	gtk_combo_box_set_active(GTK_COMBO_BOX(window_combo), spec->want_window);
+	gtk_box_pack_start(GTK_BOX(hbox), window_combo, TRUE, TRUE, 0);
+
 	wfdisplay = sdr_waterfall_new(GTK_ADJUSTMENT(sdr->tuning), GTK_ADJUSTMENT(sdr->lp_tune), GTK_ADJUSTMENT(sdr->hp_tune), sdr->sample_rate, sdr->fft_size);
 	// common softrock frequencies
 	// 160m =  1844250
@@ -235,26 +477,35 @@ void gui_display(sdr_data_t *sdr, gboolean horizontal)
 	SDR_WATERFALL(wfdisplay)->centre_freq = sdr->centre_freq;
 	switch (SDR_WATERFALL(wfdisplay)->orientation) {
 	case WF_O_VERTICAL:
-		gtk_widget_set_size_request(GTK_WIDGET(wfdisplay), sdr->fft_size, 250);
+		gtk_widget_set_size_request(GTK_WIDGET(wfdisplay), MIN(sdr->fft_size, 1024), 250);
 		break;
 	case WF_O_HORIZONTAL:
-		gtk_widget_set_size_request(GTK_WIDGET(wfdisplay), 960, sdr->fft_size);
+		gtk_widget_set_size_request(GTK_WIDGET(wfdisplay), 960, MIN(sdr->fft_size, 1024));
 		break;
 	}
 	gtk_box_pack_start(GTK_BOX(vbox), GTK_WIDGET(wfdisplay), TRUE, TRUE, 0);
 	gtk_box_pack_start(GTK_BOX(vbox), hbox, TRUE, TRUE, 0);
+
+	status = gtk_statusbar_new();
+	gtk_box_pack_start(GTK_BOX(vbox), status, FALSE, FALSE, 0);
+	load_snapshot(&sdr->load, &load_last);
 	
 	gtk_widget_show_all(mainWindow);
 
 	// connect handlers
 	// FIXME - determine minimum update rate from jack latency
 	g_timeout_add(25,  (GSourceFunc)gui_update_waterfall, (gpointer)wfdisplay);
+	g_timeout_add(1000, gui_update_load, sdr);
 	gtk_signal_connect(GTK_OBJECT(sdr->tuning), "value-changed", G_CALLBACK(tuning_changed), sdr);
 	gtk_signal_connect(GTK_OBJECT(sdr->lp_tune), "value-changed", G_CALLBACK(filter_changed), sdr);
 	gtk_signal_connect(GTK_OBJECT(sdr->hp_tune), "value-changed", G_CALLBACK(filter_changed), sdr);
 	gtk_signal_connect(GTK_OBJECT(filter_combo), "changed", G_CALLBACK(filter_clicked), sdr);
 	gtk_signal_connect(GTK_OBJECT(mode_combo), "changed", G_CALLBACK(mode_changed), sdr);
 	gtk_signal_connect(GTK_OBJECT(agc_combo), "changed", G_CALLBACK(agc_changed), sdr);
+	gtk_signal_connect(GTK_OBJECT(window_combo), "changed", G_CALLBACK(window_changed), spec);
+	gtk_signal_connect(GTK_OBJECT(wfdisplay), "scroll-event", G_CALLBACK(gui_history_scroll), NULL);
+	if (rx_combo)
+		gtk_signal_connect(GTK_OBJECT(rx_combo), "changed", G_CALLBACK(rx_changed), sdr);
 }
 
 /* vim: set noexpandtab ai ts=4 sw=4 tw=4: */
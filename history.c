@@ -0,0 +1,175 @@
+/*  lysdr Software Defined Radio
+	(C) 2010-2011 Gordon JC Pearce MM0YEQ and others
+
+	history.c
+	keep every waterfall row on disk, a byte per bin, in a memory-mapped
+	file; each level of the pyramid is a ring of rows, and each row of a
+	level is the max of HISTORY_FACTOR rows of the one below, so the
+	coarse levels reach back days while the file stays a fixed size
+
+	This file is part of lysdr.
+
+	lysdr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	any later version.
+
+	lysdr is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with lysdr.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <gtk/gtk.h>
+
+#include "history.h"
+
+#define HISTORY_HEADER 4096	// the header gets a page to itself
+
+// the spectrum thread appends, the GUI reads; a row read while it's being
+// written just looks a bit odd for a moment, so there's no lock
+
+static guchar *history_row(history_t *hist, gint level, guint64 index) {
+	// row index of a level's ring; index HISTORY_ROWS is the row being merged
+	gsize offset = HISTORY_HEADER + ((gsize)level * (HISTORY_ROWS + 1) + index) * hist->stride;
+	return hist->map + offset;
+}
+
+static gboolean history_matches(history_header_t *head, gint bins, gint sample_rate) {
+	// an existing file can only be added to if its rows mean the same thing
+	return !memcmp(head->magic, HISTORY_MAGIC, 8) && head->version == HISTORY_VERSION &&
+		head->bins == bins && head->levels == HISTORY_LEVELS && head->factor == HISTORY_FACTOR &&
+		head->rows == HISTORY_ROWS && head->sample_rate == sample_rate;
+}
+
+history_t *history_open(const gchar *path, gint fft_size, gint sample_rate) {
+	// map the history file, starting it afresh if it's new or was made with other settings
+	history_t *hist = g_new0(history_t, 1);
+	history_header_t *head;
+	gint bins = MIN(fft_size, HISTORY_BINS);
+
+	hist->bins = bins;
+	hist->stride = sizeof(gint64) + ((bins + 7) & ~7);	// keep the times aligned
+	hist->size = HISTORY_HEADER + (gsize)HISTORY_LEVELS * (HISTORY_ROWS + 1) * hist->stride;
+
+	hist->fd = open(path, O_RDWR | O_CREAT, 0644);
+	if (hist->fd < 0) {
+		perror(path);
+		g_free(hist);
+		return NULL;
+	}
+	// a sparse file; the disk only fills as rows are written
+	if (ftruncate(hist->fd, hist->size) < 0) {
+		perror(path);
+		close(hist->fd);
+		g_free(hist);
+		return NULL;
+	}
+	hist->map = mmap(NULL, hist->size, PROT_READ | PROT_WRITE, MAP_SHARED, hist->fd, 0);
+	if (hist->map == MAP_FAILED) {
+		perror(path);
+		close(hist->fd);
+		g_free(hist);
+		return NULL;
+	}
+
+	head = hist->head = (history_header_t *)hist->map;
+	if (!history_matches(head, bins, sample_rate)) {
+		if (head->magic[0])
+			fprintf(stderr, "%s was recorded with other settings, starting it again\n", path);
+		memset(head, 0, sizeof(history_header_t));
+		memcpy(head->magic, HISTORY_MAGIC, 8);
+		head->version = HISTORY_VERSION;
+		head->bins = bins;
+		head->levels = HISTORY_LEVELS;
+		head->factor = HISTORY_FACTOR;
+		head->rows = HISTORY_ROWS;
+		head->sample_rate = sample_rate;
+	}
+	hist->row = g_new(guchar, bins);
+	return hist;
+}
+
+void history_close(history_t *hist) {
+	msync(hist->map, hist->size, MS_ASYNC);
+	munmap(hist->map, hist->size);
+	close(hist->fd);
+	g_free(hist->row);
+	g_free(hist);
+}
+
+static void history_push(history_t *hist, gint level, const guchar *q, gint64 time) {
+	// write a row to one level, and merge it into the next level up
+	history_header_t *head = hist->head;
+	guchar *row = history_row(hist, level, head->written[level] % HISTORY_ROWS);
+	guchar *next;
+	gint i;
+
+	*(gint64 *)row = time;
+	memcpy(row + sizeof(gint64), q, hist->bins);
+	head->written[level]++;
+
+	if (level + 1 >= HISTORY_LEVELS)
+		return;
+	next = history_row(hist, level + 1, HISTORY_ROWS) + sizeof(gint64);
+	if (head->pending[level + 1] == 0)
+		memcpy(next, q, hist->bins);
+	else
+		for (i = 0; i < hist->bins; i++)
+			next[i] = MAX(next[i], q[i]);
+	if (++head->pending[level + 1] == HISTORY_FACTOR) {
+		head->pending[level + 1] = 0;
+		history_push(hist, level + 1, next, time);
+	}
+}
+
+void history_append(history_t *hist, const gfloat *power, gint fft_size, gfloat scale, gint64 time) {
+	// add a row from the spectrum thread's power sums, in FFT order; scale
+	// makes them the power of one FFT, and time is when, in microseconds
+	gint b, i, p, lo, hi, half = fft_size / 2;
+	gfloat peak, db;
+
+	for (b = 0; b < hist->bins; b++) {
+		// the strongest of the bins that fall in this one, lowest frequency first
+		lo = b * fft_size / hist->bins;
+		hi = (b + 1) * fft_size / hist->bins;
+		peak = 0;
+		for (i = lo; i < hi; i++) {
+			p = i < half ? i + half : i - half;
+			peak = MAX(peak, power[p]);
+		}
+		db = 10 * log10f(peak * scale);
+		hist->row[b] = CLAMP((db - HISTORY_FLOOR) / HISTORY_STEP, 0, 255);
+	}
+	history_push(hist, 0, hist->row, time);
+}
+
+guint64 history_length(history_t *hist, gint level) {
+	// rows that can still be read from a level
+	return MIN(hist->head->written[level], HISTORY_ROWS);
+}
+
+const guchar *history_get(history_t *hist, gint level, guint64 back, gint64 *time) {
+	// the row back rows before the newest of a level, and when it ended;
+	// NULL if it's older than the level goes
+	guint64 written = hist->head->written[level];
+	guchar *row;
+
+	if (back >= history_length(hist, level))
+		return NULL;
+	row = history_row(hist, level, (written - 1 - back) % HISTORY_ROWS);
+	if (time)
+		*time = *(gint64 *)row;
+	return row + sizeof(gint64);
+}
+
+/* vim: set noexpandtab ai ts=4 sw=4 tw=4: */
@@ -0,0 +1,65 @@
+/*  lysdr Software Defined Radio
+	(C) 2010-2011 Gordon JC Pearce MM0YEQ and others
+
+	history.h
+	waterfall history on disk, as a pyramid of ever coarser rows in time
+
+	This file is part of lysdr.
+
+	lysdr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	any later version.
+
+	lysdr is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with lysdr.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __HISTORY_H
+#define __HISTORY_H
+
+#include <gtk/gtk.h>
+
+#define HISTORY_MAGIC "LYSDRHIS"
+#define HISTORY_VERSION 1
+#define HISTORY_BINS 1024	// most bins in a row; narrower FFTs keep all theirs
+#define HISTORY_LEVELS 7	// level 0 is every waterfall row...
+#define HISTORY_FACTOR 4	// ...and each level above holds the max of this many rows of the one below
+#define HISTORY_ROWS 32768	// rows kept in each level before the oldest are overwritten
+#define HISTORY_FLOOR -130	// dB that quantises to 0; each step up is HISTORY_STEP dB
+#define HISTORY_STEP 0.5
+
+// at the start of the file; everything is in the host's byte order
+typedef struct {
+	gchar magic[8];
+	guint32 version;
+	guint32 bins, levels, factor, rows;
+	guint32 sample_rate;
+	guint64 written[HISTORY_LEVELS];	// rows ever written to each level
+	guint32 pending[HISTORY_LEVELS];	// rows merged so far into the next row of each level
+} history_header_t;
+
+typedef struct {
+	gint fd;
+	gsize size;
+	guchar *map;			// the whole file
+	history_header_t *head;
+	gint bins;
+	gint stride;			// bytes in a row: its time, then a byte per bin
+	guchar *row;			// the row being added, quantised
+} history_t;
+
+history_t *history_open(const gchar *path, gint fft_size, gint sample_rate);
+void history_close(history_t *hist);
+void history_append(history_t *hist, const gfloat *power, gint fft_size, gfloat scale, gint64 time);
+guint64 history_length(history_t *hist, gint level);
+const guchar *history_get(history_t *hist, gint level, guint64 back, gint64 *time);
+
+#endif
+
+/* vim: set noexpandtab ai ts=4 sw=4 tw=4: */
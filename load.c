@@ -0,0 +1,100 @@
+/*  lysdr Software Defined Radio
+	(C) 2010-2011 Gordon JC Pearce MM0YEQ and others
+
+	load.c
+	a histogram of DSP load per period, and xruns, for the status bar and SIGUSR1
+
+	This file is part of lysdr.
+
+	lysdr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	any later version.
+
+	lysdr is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with lysdr.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <gtk/gtk.h>
+#include "load.h"
+
+void load_record(sdr_load_t *load, gint64 busy, gint64 period) {
+	// count one period that kept the DSP busy for busy out of period, in any units
+	// called from the audio thread, so no locks; the last bin catches overruns
+	gint bin = period > 0 ? busy * (100 / LOAD_BIN_WIDTH) / period : 0;
+
+	g_atomic_int_inc(&load->bins[CLAMP(bin, 0, LOAD_BINS - 1)]);
+}
+
+void load_xrun(sdr_load_t *load) {
+	g_atomic_int_inc(&load->xruns);
+}
+
+void load_snapshot(sdr_load_t *load, load_snapshot_t *snap) {
+	// copy the counts out; each is read atomically, and a period landing
+	// part way through only moves the totals by one
+	gint i;
+
+	for (i = 0; i < LOAD_BINS; i++)
+		snap->bins[i] = g_atomic_int_get(&load->bins[i]);
+	snap->xruns = g_atomic_int_get(&load->xruns);
+}
+
+void load_summarise(const load_snapshot_t *now, const load_snapshot_t *then, load_summary_t *sum) {
+	// statistics for the periods between two snapshots, or since the start if then is NULL
+	// min is the bottom of its bin; p99 and max are the top of theirs, to err on the safe side
+	gint i, n, seen = 0, lo = -1, hi = -1, p99 = -1;
+	gdouble total = 0;
+
+	memset(sum, 0, sizeof(*sum));
+	for (i = 0; i < LOAD_BINS; i++) {
+		n = now->bins[i] - (then ? then->bins[i] : 0);
+		if (n <= 0)
+			continue;
+		if (lo < 0) lo = i;
+		hi = i;
+		sum->periods += n;
+		total += n * (i + 0.5);
+	}
+	sum->xruns = now->xruns - (then ? then->xruns : 0);
+	if (!sum->periods)
+		return;
+
+	for (i = lo; i <= hi; i++) {
+		seen += now->bins[i] - (then ? then->bins[i] : 0);
+		if (seen * 100.0 >= sum->periods * 99.0) {
+			p99 = i;
+			break;
+		}
+	}
+	sum->min = lo * LOAD_BIN_WIDTH;
+	sum->avg = total / sum->periods * LOAD_BIN_WIDTH;
+	sum->p99 = (p99 + 1) * LOAD_BIN_WIDTH;
+	sum->max = (hi + 1) * LOAD_BIN_WIDTH;
+}
+
+void load_dump(sdr_load_t *load, FILE *f) {
+	// everything since the start, one line of totals then the histogram, for scripts
+	load_snapshot_t snap;
+	load_summary_t sum;
+	gint i;
+
+	load_snapshot(load, &snap);
+	load_summarise(&snap, NULL, &sum);
+	fprintf(f, "load periods=%u xruns=%d min=%.1f avg=%.1f p99=%.1f max=%.1f\n",
+		sum.periods, sum.xruns, sum.min, sum.avg, sum.p99, sum.max);
+	for (i = 0; i < LOAD_BINS; i++) {
+		if (snap.bins[i])
+			fprintf(f, "load bin=%.1f periods=%d\n", i * LOAD_BIN_WIDTH, snap.bins[i]);
+	}
+	fflush(f);
+}
+
+/* vim: set noexpandtab ai ts=4 sw=4 tw=4: */
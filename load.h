@@ -0,0 +1,57 @@
+/*  lysdr Software Defined Radio
+	(C) 2010-2011 Gordon JC Pearce MM0YEQ and others
+
+	load.h
+	how much of each period the DSP takes, kept without locks
+
+	This file is part of lysdr.
+
+	lysdr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	any later version.
+
+	lysdr is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with lysdr.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __LOAD_H
+#define __LOAD_H
+
+#include <stdio.h>
+#include <gtk/gtk.h>
+
+#define LOAD_BINS 400		// histogram bins, from no load up to twice the period
+#define LOAD_BIN_WIDTH 0.5	// percent of the period in each bin
+
+// written only by the audio thread, read by anyone with load_snapshot
+typedef struct {
+	volatile gint bins[LOAD_BINS];	// periods that took each fraction of the period
+	volatile gint xruns;
+} sdr_load_t;
+
+typedef struct {
+	gint bins[LOAD_BINS];
+	gint xruns;
+} load_snapshot_t;
+
+typedef struct {
+	guint periods;
+	gint xruns;
+	gdouble min, avg, p99, max;	// percent of the period
+} load_summary_t;
+
+void load_record(sdr_load_t *load, gint64 busy, gint64 period);
+void load_xrun(sdr_load_t *load);
+void load_snapshot(sdr_load_t *load, load_snapshot_t *snap);
+void load_summarise(const load_snapshot_t *now, const load_snapshot_t *then, load_summary_t *sum);
+void load_dump(sdr_load_t *load, FILE *f);
+
+#endif
+
+/* vim: set noexpandtab ai ts=4 sw=4 tw=4: */
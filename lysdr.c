@@ -21,21 +21,52 @@
 */
 
 #include <gtk/gtk.h>
+#include <glib-unix.h>
 #include <stdlib.h>
+#include <signal.h>
 
 #include "sdr.h"
 #include "audio_jack.h"
+#include "audio_file.h"
+#include "batch.h"
 #include "filter.h"
+#include "spectrum.h"
+#include "history.h"
+#include "wisdom.h"
 
-extern void gui_display(sdr_data_t *sdr, gboolean horizontal);  // ugh, there should be a header file for the GUI
+extern void gui_display(sdr_data_t *sdr, spectrum_t *spec, gboolean horizontal);  // ugh, there should be a header file for the GUI
 sdr_data_t *sdr;
+static spectrum_t *spectrum;
+static history_t *history = NULL;
 
 static gboolean connect_input = FALSE;
 static gboolean connect_output = FALSE;
 static gboolean horizontal = FALSE;
 static gint centre_freq = 0;
 static gint fft_size = 1024;
+static gint fir_taps = 64;
+static gchar *fir_engine = NULL;
+static gchar *demod_name = NULL;
+static gint decimation = 1;
+static gint receivers = 1;
+static gchar *plan_fft = NULL;
+static gchar *window_name = NULL;
+static gchar *hold_name = NULL;
+static gchar *history_file = NULL;
+static gint overlap = 50;
+static gint average = 0;
 static gchar *tuning_hook = NULL;
+static gchar *input_file = NULL;
+static gchar *input_format = NULL;
+static gint input_rate = 48000;
+static gint input_period = 1024;
+static gboolean swap_iq = FALSE;
+static gboolean max_speed = FALSE;
+static gchar *batch_file = NULL;
+static gchar *batch_out = NULL;
+static gdouble freq_offset = 0;
+static gchar *mode_name = NULL;
+static gboolean no_crossfade = FALSE;
 
 static GOptionEntry opts[] = 
 {
@@ -44,7 +75,29 @@ static GOptionEntry opts[] =
 	{ "co", 0, 0, G_OPTION_ARG_NONE, &connect_output, "Autoconnect output to first two jack playback ports", NULL },
 	{ "freq", 'f', 0, G_OPTION_ARG_INT, &centre_freq, "Set the centre frequency in Hz", "FREQUENCY" },
 	{ "fft-size", 'F', 0, G_OPTION_ARG_INT, &fft_size, "Set the FFT size (default=1024)", "FFT_SIZE" },
+	{ "taps", 't', 0, G_OPTION_ARG_INT, &fir_taps, "Set the number of channel filter taps (default=64)", "TAPS" },
+	{ "fir-engine", 0, 0, G_OPTION_ARG_STRING, &fir_engine, "Channel filter engine: direct, fft or auto (default=auto)", "ENGINE" },
+	{ "demod", 0, 0, G_OPTION_ARG_STRING, &demod_name, "Sideband selection: fir, by the channel filter, or phasing, by a Hilbert transform (default=fir)", "DEMOD" },
+	{ "no-crossfade", 0, 0, G_OPTION_ARG_NONE, &no_crossfade, "Change the channel filter at once, rather than fading to it over a period", NULL },
+	{ "decimate", 'd', 0, G_OPTION_ARG_INT, &decimation, "Run the channel filter at 1/N of the sample rate, N a power of two (default=1)", "N" },
+	{ "receivers", 'r', 0, G_OPTION_ARG_INT, &receivers, "Number of independent receivers (default=1)", "N" },
+	{ "window", 'w', 0, G_OPTION_ARG_STRING, &window_name, "Waterfall window: hann, hamming, blackman-harris, flat-top or kaiser[:beta] (default=hamming)", "WINDOW" },
+	{ "hold", 0, 0, G_OPTION_ARG_STRING, &hold_name, "How FFT bins sharing a waterfall pixel are combined: max or mean (default=max)", "HOLD" },
+	{ "history", 0, 0, G_OPTION_ARG_FILENAME, &history_file, "Keep the waterfall's history in FILE, to look back through with alt-scroll", "FILE" },
+	{ "overlap", 0, 0, G_OPTION_ARG_INT, &overlap, "Waterfall FFT overlap in percent (default=50)", "PERCENT" },
+	{ "average", 0, 0, G_OPTION_ARG_INT, &average, "FFTs averaged per waterfall row (default=enough for 40 rows a second)", "N" },
+	{ "plan-fft", 0, 0, G_OPTION_ARG_STRING, &plan_fft, "Plan FFT sizes (comma-separated) thoroughly, save the wisdom and exit", "SIZES" },
 	{ "tuning-hook", 0, 0, G_OPTION_ARG_STRING, &tuning_hook, "Program to run when tuned frequency changes", "PROGRAM" },
+	{ "input", 'i', 0, G_OPTION_ARG_FILENAME, &input_file, "Read I/Q from a file instead of JACK", "FILE" },
+	{ "input-format", 0, 0, G_OPTION_ARG_STRING, &input_format, "Input file format: wav, or raw s16, s32 or f32 (default=wav)", "FORMAT" },
+	{ "rate", 0, 0, G_OPTION_ARG_INT, &input_rate, "Sample rate of a raw input file (default=48000)", "RATE" },
+	{ "period", 0, 0, G_OPTION_ARG_INT, &input_period, "Frames processed at a time from an input file (default=1024)", "FRAMES" },
+	{ "swap-iq", 0, 0, G_OPTION_ARG_NONE, &swap_iq, "Take I from the right input channel", NULL },
+	{ "max-speed", 0, 0, G_OPTION_ARG_NONE, &max_speed, "Read the input file as fast as possible, not in real time", NULL },
+	{ "batch", 'b', 0, G_OPTION_ARG_FILENAME, &batch_file, "Demodulate an I/Q file without the GUI or JACK, as fast as possible", "FILE" },
+	{ "out", 'o', 0, G_OPTION_ARG_FILENAME, &batch_out, "Write the batch audio to a 16 bit WAV file", "FILE" },
+	{ "freq-offset", 0, 0, G_OPTION_ARG_DOUBLE, &freq_offset, "Batch tuning offset from the centre frequency in Hz", "HZ" },
+	{ "mode", 'm', 0, G_OPTION_ARG_STRING, &mode_name, "Batch demodulator: LSB or USB (default=LSB)", "MODE" },
 	{ NULL }
 };
 
@@ -61,7 +114,7 @@ static void hook_setup(gpointer data) {
 	g_string_printf(s, "%d", sdr->centre_freq + tuning);
 	g_setenv("LYSDR_FREQ", s->str, TRUE);
 
-	switch (sdr->mode) {
+	switch (sdr->rx[sdr->active]->mode) {
 		case SDR_LSB:
 			g_string_printf(s, "LSB");
 			break;
@@ -88,6 +141,12 @@ static gboolean run_hook(gpointer data) {
 	return FALSE;
 }
 
+static gboolean dump_load(gpointer data) {
+	// SIGUSR1: print the DSP load statistics since startup
+	load_dump(&sdr->load, stderr);
+	return TRUE;
+}
+
 static guint tuning_hook_timeout = 0;
 
 static void tuning_changed(GtkAdjustment *adjustment, gpointer data) {
@@ -103,47 +162,159 @@ static void tuning_changed(GtkAdjustment *adjustment, gpointer data) {
 int main(int argc, char *argv[]) {
 	GError *error = NULL;
 	GOptionContext *context;
+	gint engine = FIR_AUTO;
+	gint demod = SDR_DEMOD_FIR;
+	gfloat bw, centre;
+	gint window = WINDOW_HAMMING;
+	gdouble beta = SPECTRUM_KAISER_BETA;
+	gint hold = HOLD_MAX;
+	gint mode = SDR_LSB;
+	audio_backend_t *audio = &audio_jack;
+	gint i;
 
 
 	printf("lysdr starting\n");
 	
 	gdk_threads_init();
-	gdk_threads_enter();
 
-	gtk_init(&argc, &argv);
-	
+	// parse without opening the display, which batch mode doesn't want
 	context = g_option_context_new ("-");
 	g_option_context_add_main_entries (context, opts, NULL);
-	g_option_context_add_group (context, gtk_get_option_group (TRUE));
+	g_option_context_add_group (context, gtk_get_option_group (FALSE));
 	if (!g_option_context_parse (context, &argc, &argv, &error)) {
 		g_print ("option parsing failed: %s\n", error->message);
 		exit (1);
 	}
 
-	// create a new SDR, and set up the jack client
+	if (plan_fft)
+		exit(wisdom_plan_sizes(plan_fft) ? 0 : 1);
+
+	if (fir_engine) {
+		if (!g_ascii_strcasecmp(fir_engine, "direct")) engine = FIR_DIRECT;
+		else if (!g_ascii_strcasecmp(fir_engine, "fft")) engine = FIR_FFT;
+		else if (g_ascii_strcasecmp(fir_engine, "auto")) {
+			g_print("unknown filter engine \"%s\"\n", fir_engine);
+			exit(1);
+		}
+	}
+
+	if (demod_name) {
+		if (!g_ascii_strcasecmp(demod_name, "phasing")) demod = SDR_DEMOD_PHASING;
+		else if (g_ascii_strcasecmp(demod_name, "fir")) {
+			g_print("unknown demodulator \"%s\"\n", demod_name);
+			exit(1);
+		}
+	}
+
+	if (window_name && !spectrum_parse_window(window_name, &window, &beta)) {
+		g_print("unknown window \"%s\"\n", window_name);
+		exit(1);
+	}
+
+	if (hold_name && !spectrum_parse_hold(hold_name, &hold)) {
+		g_print("unknown hold \"%s\"\n", hold_name);
+		exit(1);
+	}
+
+	if (mode_name) {
+		if (!g_ascii_strcasecmp(mode_name, "usb")) mode = SDR_USB;
+		else if (g_ascii_strcasecmp(mode_name, "lsb")) {
+			g_print("unknown mode \"%s\"\n", mode_name);
+			exit(1);
+		}
+	}
+
+	if (batch_file) {
+		if (receivers != 1) {
+			g_print("batch mode runs a single receiver\n");
+			exit(1);
+		}
+		input_file = batch_file;
+		max_speed = TRUE;
+	}
+
+	if (input_file) {
+		if (!audio_file_setup(input_file, input_format, input_rate, input_period, !max_speed))
+			exit(1);
+		audio = &audio_file;
+	}
+
+	// create a new SDR, and open the source of samples
 	sdr = sdr_new(fft_size);
-	audio_start(sdr);
+	sdr->swap_iq = swap_iq;
+	if (audio->start(sdr))
+		exit(1);
 
-	// define a filter and configure a default shape
-	sdr->filter = filter_fir_new(64, sdr->size);
-	filter_fir_set_response(sdr->filter, sdr->sample_rate, 3100, 1850);
-	
-	// hook up the jack ports and start the client  
+	if (!sdr_decimate_setup(sdr, decimation)) {
+		g_print("can't decimate by %d with a period of %d\n", decimation, sdr->size);
+		exit(1);
+	}
+	if (receivers < 1 || receivers > SDR_MAX_RX) {
+		g_print("can't run %d receivers, %d at most\n", receivers, SDR_MAX_RX);
+		exit(1);
+	}
+
+	// define the receivers and configure a default filter shape
+	for (i = 0; i < receivers; i++) {
+		sdr->rx[i] = sdr_rx_new(sdr, fir_taps, engine);
+		sdr_rx_set_demod(sdr->rx[i], demod);
+		sdr_rx_filter_shape(sdr->rx[i], sdr->rx[i]->lowpass, sdr->rx[i]->highpass, &bw, &centre);
+		filter_fir_set_response(sdr->rx[i]->filter, sdr->if_rate, bw, centre);
+		sdr->rx[i]->filter->crossfade = !no_crossfade;
+	}
+	sdr->receivers = receivers;
+	sdr_workers_start(sdr);
 	fft_setup(sdr);
-	audio_connect(sdr, connect_input, connect_output);
+
+	if (batch_file) {
+		sdr->rx[0]->mode = mode;
+		sdr_rx_tune(sdr->rx[0], sdr->sample_rate, freq_offset);
+		i = batch_run(sdr, batch_out) ? 0 : 1;
+		audio->stop(sdr);
+		sdr_workers_stop(sdr);
+		sdr_rx_destroy(sdr, sdr->rx[0]);
+		fft_teardown(sdr);
+		wisdom_save();
+		sdr_destroy(sdr);
+		exit(i);
+	}
+
+	gdk_threads_enter();
+	gtk_init(&argc, &argv);
+
+	// filter changes from the GUI are built off the audio thread
+	filter_designer_start();
+
+	// hook up the jack ports or the file, and start processing
+	audio->connect(sdr, connect_input, connect_output);
 	
 	sdr->centre_freq = centre_freq;
 
-	gui_display(sdr, horizontal);
+	// the spectrum thread makes waterfall rows, the GUI just draws them
+	if (history_file)
+		history = history_open(history_file, sdr->fft_size, sdr->sample_rate);
+	spectrum = spectrum_new(sdr, 25, overlap, average, history);
+	spectrum_set_window(spectrum, window, beta);
+	spectrum_set_hold(spectrum, hold);
+	gui_display(sdr, spectrum, horizontal);
 
 	gtk_signal_connect(GTK_OBJECT(sdr->tuning), "value-changed", G_CALLBACK(tuning_changed), NULL);
 
 	gtk_adjustment_set_value(GTK_ADJUSTMENT(sdr->tuning), 0);
 
+	g_unix_signal_add(SIGUSR1, dump_load, NULL);
+
 	gtk_main();
-	audio_stop(sdr);
-	filter_fir_destroy(sdr->filter);
+	spectrum_destroy(spectrum);
+	if (history)
+		history_close(history);
+	audio->stop(sdr);
+	filter_designer_stop();
+	sdr_workers_stop(sdr);
+	for (i = 0; i < sdr->receivers; i++)
+		sdr_rx_destroy(sdr, sdr->rx[i]);
 	fft_teardown(sdr);
+	wisdom_save();
 	
 	sdr_destroy(sdr);
 	gdk_threads_leave();
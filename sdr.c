@@ -28,6 +28,14 @@
 
 #include "filter.h"
 #include "sdr.h"
+#include "wisdom.h"
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 static gint blk_pos=0;
 static int n;
@@ -37,119 +45,563 @@ sdr_data_t *sdr_new(gint fft_size) {
 	sdr_data_t *sdr;
 	
 	sdr = malloc(sizeof(sdr_data_t));
-	sdr->loVector = 1;  // start the local oscillator
-	//sdr->loPhase = 1;   // this value is bogus but we're going to set the frequency anyway
-	
-	
-	sdr->loPhase = cexp(I);
-	sdr->agc_gain = 0;   // start off as quiet as possible
-	sdr->mode = SDR_LSB;
-	sdr->agc_speed = 0.005;
 	sdr->fft_size = fft_size;
+	sdr->decimation = 1;
+	sdr->stages = 0;
+	sdr->receivers = 0;
+	sdr->active = 0;
+	sdr->nworkers = 0;
+	sdr->workers = NULL;
+	sdr->dc_remove = 0;
+	sdr->swap_iq = FALSE;
+	memset(&sdr->load, 0, sizeof(sdr->load));
+	sdr->clock = 0;
+	sdr->cmd_head = sdr->cmd_tail = 0;
 	
 	return sdr; 
 }
 
+gboolean sdr_decimate_setup(sdr_data_t *sdr, gint factor) {
+	// check and record the decimation for the decimate-first path
+	// factor must be a power of two that divides the period size
+	sdr->stages = 0;
+	while ((1 << sdr->stages) < factor) sdr->stages++;
+	if (factor < 1 || (1 << sdr->stages) != factor || sdr->stages > SDR_MAX_STAGES || sdr->size % factor) {
+		sdr->stages = 0;
+		return FALSE;
+	}
+	sdr->decimation = factor;
+	sdr->if_rate = sdr->sample_rate / factor;
+	return TRUE;
+}
+
+sdr_rx_t *sdr_rx_new(sdr_data_t *sdr, gint taps, gint engine) {
+	// create a receiver, with its own oscillator, filters and AGC
+	// call sdr_decimate_setup first, the half-band cascade is built here
+	// the last stage has the narrowest transition band, so it gets the most taps
+	static const int hb_taps[] = { 47, 23, 11 };
+	sdr_rx_t *rx;
+	int i;
+
+	rx = malloc(sizeof(sdr_rx_t));
+	rx->nco_phase = 0;  // start the local oscillator
+	rx->nco_step = 0;   // at DC; the GUI sets the real frequency
+	rx->nco_req = 0;
+	rx->nco_at = -1;
+	rx->agc_gain = 0;   // start off as quiet as possible
+	rx->agc_env = 0;
+	rx->mode = SDR_LSB;
+	rx->demod = SDR_DEMOD_FIR;
+	rx->agc_speed = 0.005;
+	rx->tuning = 0;
+	rx->lowpass = 3400;
+	rx->highpass = 300;
+
+	rx->iq = g_new0(sdr_complex_t, sdr->size);
+	rx->nco_rot = g_new0(sdr_complex_t, sdr->size);
+	for (i = 0; i < sdr->size; i++)
+		rx->nco_rot[i] = 1;
+	rx->output = g_new0(gfloat, sdr->size);
+	rx->sink[0] = rx->sink[1] = NULL;
+	rx->filter = filter_fir_new(taps, sdr->size / sdr->decimation, engine);
+	rx->hilbert = filter_hilbert_new(sdr->size / sdr->decimation);
+	for (i = 0; i < sdr->stages; i++) {
+		rx->decim[i] = filter_hb_new(hb_taps[MIN(sdr->stages - 1 - i, 2)], sdr->size >> i, FALSE);
+		rx->interp[i] = filter_hb_new(hb_taps[MIN(sdr->stages - 1 - i, 2)], sdr->size >> (i + 1), TRUE);
+	}
+	rx->scratch = sdr->stages ? g_new0(sdr_real_t, sdr->size) : NULL;
+	rx->work = sdr->stages ? g_new0(sdr_real_t, sdr->size) : NULL;
+	return rx;
+}
+
+void sdr_rx_destroy(sdr_data_t *sdr, sdr_rx_t *rx) {
+	int i;
+	for (i = 0; i < sdr->stages; i++) {
+		filter_hb_destroy(rx->decim[i]);
+		filter_hb_destroy(rx->interp[i]);
+	}
+	filter_fir_destroy(rx->filter);
+	filter_hilbert_destroy(rx->hilbert);
+	if (rx->scratch) g_free(rx->scratch);
+	if (rx->work) g_free(rx->work);
+	g_free(rx->iq);
+	g_free(rx->nco_rot);
+	g_free(rx->output);
+	free(rx);
+}
+
 void sdr_destroy(sdr_data_t *sdr) {
 	if (sdr) {
 		free(sdr);
 	}
 }
 
-int sdr_process(sdr_data_t *sdr) {
-	// actually do the SDR bit
-	int i, j, k;
-	double y, accI, accQ;
-	double complex c;
-	fft_data_t *fft = sdr->fft;
-	int size = sdr->size;
-	int block_size = MIN(size, sdr->fft_size);   // ensure we don't try to copy a block larger than FFT_SIZE
-	
-	float agc_gain = sdr->agc_gain;
-	float agc_peak = 0;
+void sdr_rx_tune(sdr_rx_t *rx, guint sample_rate, gdouble freq) {
+	// tune a receiver to freq Hz from the centre, from the start of the next period
+	// only for the audio thread, or before it starts; anything else uses sdr_command
+	// the oscillator phase carries on, so there's no click
+	rx->nco_req = (guint32)llround(-freq / sample_rate * 4294967296.0);
+	rx->nco_at = 0;
+}
+
+void sdr_rx_set_demod(sdr_rx_t *rx, gint demod) {
+	// before the channel filter is shaped, which depends on it
+	rx->demod = demod;
+	rx->filter->plain = (demod == SDR_DEMOD_PHASING);
+}
+
+void sdr_rx_filter_shape(sdr_rx_t *rx, gdouble lowpass, gdouble highpass, gfloat *bw, gfloat *centre) {
+	// the width and centre of the channel filter for a receiver to pass from
+	// highpass to lowpass Hz from the carrier, as the sliders set them
+	// it's the same for both demodulators; the phasing one's plain filter
+	// passes the mirror of the band as well, and leaves the Hilbert transform
+	// to pick the sideband, so the highpass edge cuts hum and DC either way
+	*bw = highpass - lowpass;
+	*centre = lowpass + (highpass - lowpass) / 2;
+}
+
+gboolean sdr_command(sdr_data_t *sdr, gint type, gint rx, gdouble value, guint64 when) {
+	// queue a change to receiver rx for the audio thread to make; FALSE if the queue's full
+	// there's one producer, so call this from one thread only, normally the GUI's
+	gint head = sdr->cmd_head;
+	sdr_cmd_t *cmd;
+
+	if ((guint)(head - g_atomic_int_get(&sdr->cmd_tail)) >= SDR_CMD_RING)
+		return FALSE;
+	cmd = &sdr->cmd[head & (SDR_CMD_RING - 1)];
+	cmd->type = type;
+	cmd->rx = rx;
+	cmd->value = value;
+	cmd->when = when;
+	// the command has to be there before the audio thread can see it is
+	g_atomic_int_set(&sdr->cmd_head, head + 1);
+	return TRUE;
+}
 
-	// remove DC with a highpass filter
-	for (i = 0; i < size; i++) {	   // DC removal; R.G. Lyons page 553
-		c = sdr->iqSample[i] + sdr->dc_remove * 0.95;
-		sdr->iqSample[i] = c - sdr->dc_remove;
-		sdr->dc_remove = c;
+static void sdr_commands(sdr_data_t *sdr) {
+	// make the changes that fall due in this period, in the order they were sent;
+	// one that's due later holds up the rest until its period comes round
+	// retunes land on their sample, the rest take effect for the whole period,
+	// and a second retune of a receiver in one period replaces the first
+	gint tail = sdr->cmd_tail;
+	gint head = g_atomic_int_get(&sdr->cmd_head);
+	sdr_cmd_t *cmd;
+	sdr_rx_t *rx;
+
+	for (; tail != head; tail++) {
+		cmd = &sdr->cmd[tail & (SDR_CMD_RING - 1)];
+		if (cmd->when >= sdr->clock + sdr->size)
+			break;
+		if (cmd->rx < 0 || cmd->rx >= sdr->receivers)
+			continue;
+		rx = sdr->rx[cmd->rx];
+		switch (cmd->type) {
+			case SDR_CMD_TUNE:
+				sdr_rx_tune(rx, sdr->sample_rate, cmd->value);
+				rx->nco_at = (cmd->when > sdr->clock) ? cmd->when - sdr->clock : 0;
+				break;
+			case SDR_CMD_MODE:
+				rx->mode = (gint)cmd->value;
+				break;
+			case SDR_CMD_AGC:
+				rx->agc_speed = cmd->value;
+				break;
+		}
 	}
+	g_atomic_int_set(&sdr->cmd_tail, tail);
+}
+
+#if defined(__SSE2__) && defined(SDR_SINGLE)
+static inline __m128 cmul_ps(__m128 a, __m128 b) {
+	// two complex multiplies at once, SSE2 only
+	__m128 br = _mm_shuffle_ps(b, b, _MM_SHUFFLE(2, 2, 0, 0));
+	__m128 bi = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 3, 1, 1));
+	__m128 as = _mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1));
+	__m128 t = _mm_xor_ps(_mm_mul_ps(as, bi), _mm_set_ps(0.0f, -0.0f, 0.0f, -0.0f));
+	return _mm_add_ps(_mm_mul_ps(a, br), t);
+}
+#elif defined(__SSE2__)
+static inline __m128d cmul_pd(__m128d a, __m128d b) {
+	// one complex multiply, SSE2 only
+	__m128d br = _mm_unpacklo_pd(b, b);
+	__m128d bi = _mm_unpackhi_pd(b, b);
+	__m128d as = _mm_shuffle_pd(a, a, 1);
+	__m128d t = _mm_xor_pd(_mm_mul_pd(as, bi), _mm_set_pd(0.0, -0.0));
+	return _mm_add_pd(_mm_mul_pd(a, br), t);
+}
+#endif
 
-	// copy this period to FFT buffer, or as much as will fit
-	// note that if the jack periodsize is greater than FFT_LEN, it will only copy FFT_LEN samples
-	memmove(fft->samples, fft->samples+block_size, sizeof(double complex)*(sdr->fft_size-block_size)); // move the last lot up
-	memmove(fft->samples+sdr->fft_size-block_size, sdr->iqSample, sizeof(double complex)*block_size);  // copy the current block
+static void nco_mix(sdr_complex_t *out, const sdr_complex_t *in, const sdr_complex_t *rot, sdr_complex_t lo, int n) {
+	// out[k] = in[k] * lo * rot[k]; no sample depends on the one before
+	int k = 0;
+#if defined(__SSE2__) && defined(SDR_SINGLE)
+	__m128 vlo = _mm_setr_ps(crealf(lo), cimagf(lo), crealf(lo), cimagf(lo));
+	for (; k + 2 <= n; k += 2) {
+		__m128 w = cmul_ps(_mm_loadu_ps((const float *)(rot + k)), vlo);
+		_mm_storeu_ps((float *)(out + k), cmul_ps(_mm_loadu_ps((const float *)(in + k)), w));
+	}
+#elif defined(__SSE2__)
+	__m128d vlo = _mm_setr_pd(creal(lo), cimag(lo));
+	for (; k < n; k++) {
+		__m128d w = cmul_pd(_mm_loadu_pd((const double *)(rot + k)), vlo);
+		_mm_storeu_pd((double *)(out + k), cmul_pd(_mm_loadu_pd((const double *)(in + k)), w));
+	}
+#endif
+	for (; k < n; k++)
+		out[k] = in[k] * (lo * rot[k]);
+}
 
+static gint sdr_rx_split(sdr_data_t *sdr, sdr_rx_t *rx) {
+	// the sample a retune splits this period at, or the period size if there isn't one
+	return (rx->nco_at >= 0) ? rx->nco_at : sdr->size;
+}
 
+static void nco_rotations(sdr_complex_t *rot, guint32 step, gint n) {
+	// e^(i.step.k) for k up to n, by repeated multiplication rather than a cexp
+	// for each, as this runs on the audio thread whenever a receiver is retuned;
+	// it's worked in double and renormalised every so often, so the error stays
+	// far below anything a float would see
+	gdouble wr = cos(NCO_RADIANS * step), wi = sin(NCO_RADIANS * step);
+	gdouble zr = 1, zi = 0, t;
+	gint k;
 
-	// shift frequency
-	for (i = 0; i < size; i++) {
-		sdr->iqSample[i] *= sdr->loVector;
-		sdr->loVector *= sdr->loPhase;
+	for (k = 0; k < n; k++) {
+		rot[k] = zr + I * zi;
+		t = zr * wr - zi * wi;
+		zi = zr * wi + zi * wr;
+		zr = t;
+		if ((k & (NCO_RENORM - 1)) == NCO_RENORM - 1) {
+			// one Newton step towards |z| = 1, no square root needed
+			t = (3 - (zr * zr + zi * zi)) / 2;
+			zr *= t;
+			zi *= t;
+		}
 	}
+}
 
-/*
-	// demodulate by performing a Hilbert transform and then summing real and imaginary
+static sdr_complex_t sdr_rx_nco(sdr_data_t *sdr, sdr_rx_t *rx, gint from, gint to) {
+	// retune if it's due at from, and move the oscillator on over samples from
+	// up to to; sample k of them is mixed with the returned phase times nco_rot[k]
+	// the phase is an integer, so the frequency is exact and never drifts,
+	// and each period starts from it afresh, so rounding can't build up
+	guint32 step;
+	sdr_complex_t lo;
 
-	switch(sdr->mode) {
-		case SDR_LSB:
-			filter_hilbert(-1, sdr->iqSample, size);
-			break;
-		case SDR_USB:
-			filter_hilbert(1, sdr->iqSample, size);
-			break;
-	} 
+	if (from == rx->nco_at) {
+		rx->nco_at = -1;
+		if (rx->nco_req != rx->nco_step) {
+			// retuned: the rotations change, the phase carries on
+			rx->nco_step = rx->nco_req;
+			nco_rotations(rx->nco_rot, rx->nco_step, sdr->size);
+		}
+	}
+	step = rx->nco_step;
+	lo = cexp(I * NCO_RADIANS * (guint32)(rx->nco_phase - step * from));
+	rx->nco_phase += step * (to - from);
+	return lo;
+}
+
+static void sdr_rx_mix(sdr_data_t *sdr, sdr_rx_t *rx) {
+	// mix the shared input down to baseband, into this receiver's buffer,
+	// in two runs if it's retuned part way through the period
+	gint at = sdr_rx_split(sdr, rx);
+
+	if (at > 0)
+		nco_mix(rx->iq, sdr->iqSample, rx->nco_rot, sdr_rx_nco(sdr, rx, 0, at), at);
+	if (at < sdr->size)
+		nco_mix(rx->iq + at, sdr->iqSample + at, rx->nco_rot + at, sdr_rx_nco(sdr, rx, at, sdr->size), sdr->size - at);
+}
 
-	for (i=0; i < size; i++) {
-		 y = creal(sdr->iqSample[i])+cimag(sdr->iqSample[i]);
-		sdr->output[i] = y;
+static void sdr_input(sdr_data_t *sdr, const gfloat *in_i, const gfloat *in_q, gint from, gint to,
+		sdr_complex_t *ring, sdr_complex_t *shared, sdr_rx_t *rx, sdr_complex_t lo) {
+	// samples from up to to of the period, in one pass: make them complex, block
+	// DC, and write them to the FFT ring (ring is where sample from goes), to shared
+	// for the receivers that mix for themselves, and mixed to baseband for rx;
+	// shared and rx can be NULL
+	sdr_complex_t c, y, dc = sdr->dc_remove;
+	int k = from;
+#if defined(__SSE2__) && defined(SDR_SINGLE)
+	// two samples at a time; the second's DC state is worked out from the first's
+	const __m128 a = _mm_set1_ps(SDR_DC_POLE);
+	const __m128 a12 = _mm_setr_ps(SDR_DC_POLE, SDR_DC_POLE, SDR_DC_POLE * SDR_DC_POLE, SDR_DC_POLE * SDR_DC_POLE);
+	__m128 vlo = _mm_setr_ps(crealf(lo), cimagf(lo), crealf(lo), cimagf(lo));
+	__m128 p = _mm_setr_ps(crealf(dc), cimagf(dc), crealf(dc), cimagf(dc));
+	__m128 x, vc, vy;
+
+	for (; k + 2 <= to; k += 2) {
+		x = _mm_unpacklo_ps(_mm_castpd_ps(_mm_load_sd((const double *)(in_i + k))),
+			_mm_castpd_ps(_mm_load_sd((const double *)(in_q + k))));	// I0 Q0 I1 Q1
+		vc = _mm_add_ps(_mm_add_ps(x, _mm_mul_ps(a, _mm_movelh_ps(_mm_setzero_ps(), x))), _mm_mul_ps(a12, p));
+		vy = _mm_sub_ps(vc, _mm_movelh_ps(p, vc));
+		p = _mm_movehl_ps(vc, vc);
+		_mm_storeu_ps((float *)(ring + k - from), vy);
+		if (shared)
+			_mm_storeu_ps((float *)(shared + k), vy);
+		if (rx)
+			_mm_storeu_ps((float *)(rx->iq + k), cmul_ps(vy, cmul_ps(_mm_loadu_ps((const float *)(rx->nco_rot + k)), vlo)));
 	}
+	_mm_storel_pi((__m64 *)&dc, p);
+#elif defined(__SSE2__)
+	const __m128d a = _mm_set1_pd(SDR_DC_POLE);
+	__m128d vlo = _mm_setr_pd(creal(lo), cimag(lo));
+	__m128d p = _mm_setr_pd(creal(dc), cimag(dc));
+	__m128d vc, vy;
 
-	//filter_iir_process(sdr->filter, sdr->output);
+	for (; k < to; k++) {
+		vc = _mm_add_pd(_mm_setr_pd(in_i[k], in_q[k]), _mm_mul_pd(a, p));
+		vy = _mm_sub_pd(vc, p);
+		p = vc;
+		_mm_storeu_pd((double *)(ring + k - from), vy);
+		if (shared)
+			_mm_storeu_pd((double *)(shared + k), vy);
+		if (rx)
+			_mm_storeu_pd((double *)(rx->iq + k), cmul_pd(vy, cmul_pd(_mm_loadu_pd((const double *)(rx->nco_rot + k)), vlo)));
+	}
+	_mm_storeu_pd((double *)&dc, p);
+#endif
+	for (; k < to; k++) {
+		c = in_i[k] + I * in_q[k] + dc * SDR_DC_POLE;
+		y = c - dc;
+		dc = c;
+		ring[k - from] = y;
+		if (shared)
+			shared[k] = y;
+		if (rx)
+			rx->iq[k] = y * (lo * rx->nco_rot[k]);
+	}
+	sdr->dc_remove = dc;
+}
 
+typedef struct {
+	sdr_real_t sign;	// LSB is I+Q, USB is I-Q
+	gfloat gain, env, inv;	// inv is 1/env, kept to save a divide per sample
+	gfloat decay, grow;	// per sample, grow being 1/decay
+	gfloat release, keep;	// keep is 1 - release
+} sdr_agc_t;
 
-	
-*/
-	filter_fir_process(sdr->filter, sdr->iqSample);
+static inline sdr_real_t sdr_agc_sample(sdr_agc_t *a, sdr_complex_t z) {
+	// one sample: the peak follows the signal up at once and falls away slowly;
+	// the gain drops straight away to keep the peak at full scale, and creeps
+	// back up as agc_speed says
+	sdr_real_t x = creal(z) + a->sign * cimag(z);
+	gfloat m = fabs(x);
 
+	a->env *= a->decay;
+	a->inv *= a->grow;
+	if (m > a->env) {
+		a->env = m;
+		a->inv = 1 / m;
+	}
+	if (a->env * a->gain > 1)
+		a->gain = a->inv;
+	else
+		a->gain = a->gain * a->keep + a->inv * a->release;	// only one multiply waits on the last gain
+	return x * a->gain * 0.5;	// change volume
+}
 
-	switch(sdr->mode) {
-		case SDR_LSB:
-	for (i=0; i < size; i++) {
-		 y = creal(sdr->iqSample[i])+cimag(sdr->iqSample[i]);
-		sdr->output[i] = y;
-	}			break;
-		case SDR_USB:
-	for (i=0; i < size; i++) {
-		 y = creal(sdr->iqSample[i])-cimag(sdr->iqSample[i]);
-		sdr->output[i] = y;
-	}			break;
-	} 	
+static void sdr_demod_agc(sdr_rx_t *rx, gint n, guint rate, sdr_real_t *real, gfloat *left, gfloat *right) {
+	// demodulate, AGC and scale the filtered baseband in rx->iq, in one pass;
+	// the audio goes to real, for the interpolators, or else to left and right,
+	// float buffers that can be the audio backend's own; right can be NULL
+	sdr_agc_t a;
+	sdr_real_t x, y;
+	gint i;
 
-	// apply some AGC here
-	for (i = 0; i < size; i++) {
-		y = sdr->output[i];
-		if (agc_peak < y) agc_peak = y;
+	a.sign = (rx->mode == SDR_USB) ? -1 : 1;
+	a.gain = rx->agc_gain;
+	a.env = MAX(rx->agc_env, 0.00001f);	// don't be zero, in case we have digital silence
+	a.inv = 1 / a.env;
+	a.decay = 1 - 1.0f / (SDR_AGC_HOLD * MAX(rate, 1));
+	a.grow = 1 / a.decay;
+	a.release = rx->agc_speed / n;	// agc_speed is per period
+	a.keep = 1 - a.release;
 
+	if (rx->agc_speed < 0) {
+		// locked, just demodulate and scale
+		for (i = 0; i < n; i++) {
+			x = creal(rx->iq[i]) + a.sign * cimag(rx->iq[i]);
+			y = x * a.gain * 0.5;
+			if (real) real[i] = y; else left[i] = y;
+		}
+	} else if (real) {
+		for (i = 0; i < n; i++)
+			real[i] = sdr_agc_sample(&a, rx->iq[i]);
+	} else {
+		for (i = 0; i < n; i++)
+			left[i] = sdr_agc_sample(&a, rx->iq[i]);
 	}
-	
+	if (!real && right)
+		memcpy(right, left, n * sizeof(gfloat));
+
+	rx->agc_gain = a.gain;
+	rx->agc_env = MAX(a.env, 0.00001f);
+}
 
-	if (agc_peak == 0) agc_peak = 0.00001;	// don't be zero, in case we have digital silence
-	y = agc_peak * agc_gain;  // y is the peak level scaled by the current gain
+static void sdr_rx_process(sdr_data_t *sdr, sdr_rx_t *rx, gboolean mixed) {
+	// run one receiver over the current period, mixing it first unless sdr_input has
+	// sdr->iqSample is shared and read-only here; all the work is in rx->iq
+	int i, n;
+	sdr_real_t *out, *dst;
+	gfloat *left = rx->sink[0] ? rx->sink[0] : rx->output;
+	gfloat *right = rx->sink[0] ? rx->sink[1] : NULL;
 
-	if (sdr->agc_speed < 0) {
-		// AGC locked; don't change
-	} else if (y <= 1) {	   // Current level is below the soundcard max, increase gain
-		agc_gain += (1/ agc_peak - agc_gain) * sdr->agc_speed;
-	} else {				   // decrease gain
-		agc_gain += (1 / agc_peak - agc_gain);
+	// shift frequency, into this receiver's own buffer
+	if (!mixed)
+		sdr_rx_mix(sdr, rx);
+
+	// decimate-first path: drop to the intermediate rate before the channel filter
+	n = sdr->size;
+	for (i = 0; i < sdr->stages; i++) {
+		filter_hb_decimate(rx->decim[i], rx->iq, rx->iq);
+		n /= 2;
+	}
+
+	filter_fir_process(rx->filter, rx->iq);
+	if (rx->demod == SDR_DEMOD_PHASING)
+		filter_hilbert_process(rx->hilbert, rx->iq);
+
+	if (!sdr->stages) {
+		// at the full rate, the audio goes straight out
+		sdr_demod_agc(rx, n, sdr->if_rate, NULL, left, right);
+		return;
 	}
-	y = agc_gain * 0.5; // change volume
-	for (i = 0; i < sdr->size; i++){
-		sdr->output[i] *= y;
+
+	// otherwise back up to the jack rate first
+	sdr_demod_agc(rx, n, sdr->if_rate, rx->scratch, NULL, NULL);
+	out = rx->scratch;
+	for (i = sdr->stages - 1; i >= 0; i--) {
+		dst = (out == rx->work) ? rx->scratch : rx->work;
+		filter_hb_interpolate(rx->interp[i], out, dst);
+		out = dst;
 	}
-	
-	sdr->agc_gain = agc_gain;
+	for (i = 0; i < sdr->size; i++)
+		left[i] = out[i];
+	if (right)
+		memcpy(right, left, sdr->size * sizeof(gfloat));
+}
+
+static void *sdr_worker(void *pworker) {
+	// wait for a period, run our share of the receivers, report back
+	sdr_worker_t *w = (sdr_worker_t *)pworker;
+	sdr_data_t *sdr = (sdr_data_t *)w->sdr;
+	int i;
+
+#if defined(__SSE__)
+	// the MXCSR is per-thread, so each worker needs its own FTZ and DAZ
+	_mm_setcsr(_mm_getcsr() | 0x8040);
+#endif
+
+	for (;;) {
+		while (sem_wait(&w->go))
+			;	// interrupted by a signal, try again
+		if (sdr->quit) break;
+		for (i = w->id; i < sdr->receivers; i += sdr->nworkers + 1)
+			sdr_rx_process(sdr, sdr->rx[i], FALSE);
+		sem_post(&sdr->done);
+	}
+	return NULL;
+}
+
+void sdr_workers_start(sdr_data_t *sdr) {
+	// one thread per receiver, less the one sdr_process runs itself,
+	// but no more threads than there are CPUs to run them
+	int i;
+
+	sdr->quit = FALSE;
+	sdr->nworkers = MIN(sdr->receivers, g_get_num_processors()) - 1;
+	if (sdr->nworkers <= 0) {
+		sdr->nworkers = 0;
+		return;
+	}
+	sem_init(&sdr->done, 0, 0);
+	sdr->workers = g_new0(sdr_worker_t, sdr->nworkers);
+	for (i = 0; i < sdr->nworkers; i++) {
+		sdr->workers[i].id = i + 1;
+		sdr->workers[i].sdr = sdr;
+		sem_init(&sdr->workers[i].go, 0, 0);
+		if (pthread_create(&sdr->workers[i].thread, NULL, sdr_worker, &sdr->workers[i])) {
+			// run what we have; the JACK thread picks up the rest
+			sem_destroy(&sdr->workers[i].go);
+			break;
+		}
+	}
+	sdr->nworkers = i;
+}
+
+void sdr_workers_stop(sdr_data_t *sdr) {
+	// call this once the audio has stopped
+	int i;
+
+	sdr->quit = TRUE;
+	for (i = 0; i < sdr->nworkers; i++)
+		sem_post(&sdr->workers[i].go);
+	for (i = 0; i < sdr->nworkers; i++) {
+		pthread_join(sdr->workers[i].thread, NULL);
+		sem_destroy(&sdr->workers[i].go);
+	}
+	if (sdr->workers) {
+		sem_destroy(&sdr->done);
+		g_free(sdr->workers);
+	}
+	sdr->workers = NULL;
+	sdr->nworkers = 0;
+}
+
+static void sdr_input_run(sdr_data_t *sdr, const gfloat *in_i, const gfloat *in_q, gint from, gint to,
+		sdr_complex_t *shared, sdr_rx_t *rx, sdr_complex_t lo) {
+	// sdr_input, split where the period goes round the end of the FFT ring
+	fft_data_t *fft = sdr->fft;
+	gint wrap = fft->ring_size - fft->index;
+
+	if (from < wrap)
+		sdr_input(sdr, in_i, in_q, from, MIN(to, wrap), fft->samples + fft->index + from, shared, rx, lo);
+	if (to > wrap)
+		sdr_input(sdr, in_i, in_q, MAX(from, wrap), to, fft->samples + MAX(from, wrap) - wrap, shared, rx, lo);
+}
+
+int sdr_process(sdr_data_t *sdr, const gfloat *left, const gfloat *right) {
+	// actually do the SDR bit, on a period straight from the audio backend's buffers
+	// swapping I and Q costs nothing here, it's just which buffer is which
+	const gfloat *in_i = sdr->swap_iq ? right : left;
+	const gfloat *in_q = sdr->swap_iq ? left : right;
+	fft_data_t *fft = sdr->fft;
+	sdr_rx_t *first = sdr->receivers ? sdr->rx[0] : NULL;
+	sdr_complex_t *shared = (sdr->receivers > 1) ? sdr->iqSample : NULL;
+	int i, at;
+	int size = sdr->size;	// fft_setup makes the ring longer than a period
+
+#if defined(__SSE__)
+	// flush denormals to zero (FTZ and DAZ) rather than testing every sample
+	_mm_setcsr(_mm_getcsr() | 0x8040);
+#endif
+
+	sdr_commands(sdr);
+
+	// one pass takes the input through the DC blocker and into the FFT ring,
+	// and mixes it for the first receiver; only the others need it kept
+	// the spectrum thread reads every sample, so only say they're there once they are
+	if (first) {
+		at = sdr_rx_split(sdr, first);
+		if (at > 0)
+			sdr_input_run(sdr, in_i, in_q, 0, at, shared, first, sdr_rx_nco(sdr, first, 0, at));
+		if (at < size)
+			sdr_input_run(sdr, in_i, in_q, at, size, shared, first, sdr_rx_nco(sdr, first, at, size));
+	} else
+		sdr_input_run(sdr, in_i, in_q, 0, size, shared, NULL, 0);
+	if (fft->status != READY)
+		fft->status = ((guint)fft->written + size >= sdr->fft_size) ? READY : FILLING;
+	fft->index = (fft->index + size) & (fft->ring_size - 1);
+	g_atomic_int_add(&fft->written, size);
+	sdr->clock += size;
+
+	// kick the workers, do our own share of the receivers, then wait for the rest
+	for (i = 0; i < sdr->nworkers; i++)
+		sem_post(&sdr->workers[i].go);
+	for (i = 0; i < sdr->receivers; i += sdr->nworkers + 1)
+		sdr_rx_process(sdr, sdr->rx[i], i == 0);
+	for (i = 0; i < sdr->nworkers; i++)
+		while (sem_wait(&sdr->done))
+			;
 
 	return 0;
 }
@@ -158,27 +610,53 @@ void fft_setup(sdr_data_t *sdr) {
 	sdr->fft = (fft_data_t *)malloc(sizeof(fft_data_t));
 	fft_data_t *fft = sdr->fft;
 
-	fft->filter = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * sdr->fft_size);
+	// room for one FFT plus about a quarter of a second, so the spectrum
+	// thread can sleep between rows without losing samples
+	fft->ring_size = 1;
+	while (fft->ring_size < sdr->fft_size + sdr->sample_rate / 4 + sdr->size)
+		fft->ring_size <<= 1;
 
-	fft->windowed = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * sdr->fft_size);	
-	fft->samples = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * sdr->fft_size);
-	fft->out = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * sdr->fft_size);
-	fft->plan = fftw_plan_dft_1d(sdr->fft_size, fft->windowed, fft->out, FFTW_FORWARD, FFTW_ESTIMATE);
-	fft->htplan = fftw_plan_dft_1d(sdr->fft_size, sdr->iqSample, fft->filter, FFTW_FORWARD, FFTW_ESTIMATE);
-	fft->htbplan = fftw_plan_dft_1d(sdr->fft_size, fft->filter, sdr->iqSample, FFTW_BACKWARD, FFTW_ESTIMATE);
+	fft->windowed = (FFTW(complex)*) FFTW(malloc)(sizeof(FFTW(complex)) * sdr->fft_size);	
+	fft->samples = (FFTW(complex)*) FFTW(malloc)(sizeof(FFTW(complex)) * fft->ring_size);
+	fft->out = (FFTW(complex)*) FFTW(malloc)(sizeof(FFTW(complex)) * sdr->fft_size);
+	fft->plan = wisdom_plan(sdr->fft_size, fft->windowed, fft->out, FFTW_FORWARD);
+	memset(fft->samples, 0, sizeof(FFTW(complex)) * fft->ring_size);
 	fft->status = EMPTY;
 	fft->index = 0;
+	fft->written = 0;
+}
+
+gboolean fft_read(sdr_data_t *sdr, guint *pos, FFTW(complex) *dest) {
+	// copy the fft_size samples starting at stream position *pos, once they've arrived
+	// sdr_process never waits for us; if it has lapped the reader, or does
+	// while we copy, *pos skips forward to the newest samples and we try again
+	fft_data_t *fft = sdr->fft;
+	guint written, start, n;
+	guint lag = fft->ring_size - sdr->size;	// sdr_process may be writing the next period
+
+	for (;;) {
+		written = g_atomic_int_get(&fft->written);
+		if (written - *pos > lag - sdr->fft_size)
+			*pos = written - sdr->fft_size;
+		if (written - *pos < sdr->fft_size)
+			return FALSE;
+
+		start = *pos & (fft->ring_size - 1);
+		n = MIN(sdr->fft_size, fft->ring_size - start);
+		memcpy(dest, fft->samples + start, sizeof(FFTW(complex)) * n);
+		memcpy(dest + n, fft->samples, sizeof(FFTW(complex)) * (sdr->fft_size - n));
+
+		if ((guint)g_atomic_int_get(&fft->written) - *pos <= lag)
+			return TRUE;
+	}
 }
 
 void fft_teardown(sdr_data_t *sdr) {
 	fft_data_t *fft = sdr->fft;
-	fftw_destroy_plan(fft->plan);
-	fftw_destroy_plan(fft->htplan);
-	fftw_destroy_plan(fft->htbplan);
-	fftw_free(fft->filter);
-	fftw_free(fft->windowed);
-	fftw_free(fft->samples);
-	fftw_free(fft->out);
+	FFTW(destroy_plan)(fft->plan);
+	FFTW(free)(fft->windowed);
+	FFTW(free)(fft->samples);
+	FFTW(free)(fft->out);
 	free(sdr->fft);
 }
 
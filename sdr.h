@@ -23,62 +23,161 @@
 #define __SDR_H
 
 #include <complex.h>
+#include <pthread.h>
+#include <semaphore.h>
 #include <gtk/gtk.h>
 #include <fftw3.h>
+
+// sample precision for the whole DSP chain; configure with --single for float
+#ifdef SDR_SINGLE
+typedef float sdr_real_t;
+typedef float complex sdr_complex_t;
+#define FFTW(x) fftwf_ ## x
+#define sdr_conj(z) conjf(z)
+#else
+typedef double sdr_real_t;
+typedef double complex sdr_complex_t;
+#define FFTW(x) fftw_ ## x
+#define sdr_conj(z) conj(z)
+#endif
+
 #include "filter.h"
+#include "load.h"
 
 #define FIR_SIZE 1024
 #define MAX_FIR_LEN 8*4096
+#define SDR_MAX_STAGES 6	// half-band stages, so decimation up to 64
+#define SDR_MAX_RX 16		// receivers sharing the one I/Q stream
+#define NCO_RADIANS (2.0 * M_PI / 4294967296.0)	// one step of the oscillator phase
+#define NCO_RENORM 64	// rotations made between pulls back onto the unit circle
+#define SDR_AGC_HOLD 0.05	// seconds for the AGC's peak detector to fall by 1/e
+#define SDR_DC_POLE 0.95	// of the DC blocker on the input; R.G. Lyons page 553
+#define SDR_CMD_RING 256	// commands waiting for the audio thread, a power of two
 
 enum fft_status {EMPTY,			// fft_data is currently unused
 	FILLING,			// now writing samples to this fft
 	READY};	// ready to perform fft
 
 enum rx_mode { SDR_LSB, SDR_USB };
+enum rx_demod { SDR_DEMOD_FIR,	// the channel filter passes one sideband
+	SDR_DEMOD_PHASING };		// it passes both, and a Hilbert transform picks one
+
+enum sdr_cmd_type { SDR_CMD_TUNE, SDR_CMD_MODE, SDR_CMD_AGC,
+	SDR_CMD_TYPES };	// how many kinds there are
+
+typedef struct {
+	// a change for the audio thread to make to a receiver
+	gint type;
+	gint rx;
+	gdouble value;	// Hz from the centre, an rx_mode, or an agc_speed
+	guint64 when;	// the stream sample it takes effect at; 0 for the next period
+} sdr_cmd_t;
 
 typedef struct {
-	fftw_complex *windowed;
-	fftw_complex *samples;		// complex data for fft
-	fftw_complex *out;
-	fftw_complex *filter;
-	fftw_plan plan;			// fft plan for fftw
-	fftw_plan htplan;			// fft plan for fftw
-	fftw_plan htbplan;			// fft plan for fftw
-	int index;			// position of next fft sample
-	enum fft_status status;		// whether the fft is busy
+	FFTW(complex) *windowed;
+	FFTW(complex) *samples;		// ring of recent input samples, ring_size long
+	FFTW(complex) *out;
+	FFTW(plan) plan;			// fft plan for fftw
+	int index;			// position of next fft sample in the ring
+	int ring_size;		// a power of two, with room for the reader to lag
+	enum fft_status status;		// whether there's a whole FFT's worth yet
+	volatile gint written;		// samples ever written, wrapping; read as guint
 } fft_data_t;
 
 typedef struct {
-	double complex *iqSample;  // the array of incoming samples
-	double complex loVector;   // local oscillator vector
-	double complex loPhase;	// local oscillator phase angle (sets tuning)
-	gdouble *output;	 // pointer to output samples
+	// one receiver: everything downstream of the shared input buffer
+	sdr_complex_t *iq;	// this receiver's copy of the period, mixed to baseband
+	guint32 nco_phase;	// local oscillator phase, a whole turn is 2^32
+	guint32 nco_step;	// phase advance per sample (sets tuning)
+	guint32 nco_req;	// step to change to...
+	gint nco_at;		// ...at this sample of the period; -1 when there's no retune due
+	sdr_complex_t *nco_rot;	// e^(i.step.k) for each sample k in a period
+	gfloat *output;		// the last period's audio, when there's no sink for it
+	gfloat *sink[2];	// where this period's audio goes instead, if set; the
+						// audio backend points these at its buffers each period
+	gint mode;		  // demodulator mode
+	gint demod;		// how the sideband is picked
+
+	filter_fir_t *filter;
+	filter_hilbert_t *hilbert;
+	filter_hb_t *decim[SDR_MAX_STAGES];
+	filter_hb_t *interp[SDR_MAX_STAGES];
+	sdr_real_t *scratch;	// audio on its way back up through the interpolators
+	sdr_real_t *work;
+
+	gfloat agc_gain;
+	gfloat agc_speed;	// fraction of the way to the new gain in a period; <0 is locked
+	gfloat agc_env;		// peak detector
+
+	// remembered for the GUI, which only shows one receiver at a time
+	gdouble tuning;
+	gdouble lowpass;
+	gdouble highpass;
+} sdr_rx_t;
+
+typedef struct {
+	pthread_t thread;
+	sem_t go;	// posted once per period by sdr_process
+	gint id;	// runs receivers id, id+nworkers+1, ...
+	void *sdr;
+} sdr_worker_t;
+
+typedef struct {
+	sdr_complex_t *iqSample;  // the period after DC removal, for the receivers that mix it themselves
+	gboolean swap_iq;	// I is on the right channel
 
 	GtkObject *tuning;  // adjustment for tuning
 	GtkObject *lp_tune; // adjustment for filter lowpass
 	GtkObject *hp_tune; // adjustment for filter highpass
-	gint mode;		  // demodulator mode
 	gint centre_freq;
 
 	fft_data_t *fft;
 	gint fft_size;
-	
-	filter_fir_t *filter;
+
+	sdr_rx_t *rx[SDR_MAX_RX];
+	gint receivers;
+	gint active;	// the receiver the GUI controls
+
+	// receivers beyond the first run on worker threads
+	sdr_worker_t *workers;
+	gint nworkers;
+	sem_t done;
+	gboolean quit;
+
+	// decimate-first receive path; the channel filter and AGC run at if_rate
+	gint decimation;	// 1 for the full-rate path
+	gint stages;
+	guint if_rate;
 
 	// things to keep track of between callbacks
-	double complex dc_remove;
-	gfloat agc_gain;
-	gfloat agc_speed;
+	sdr_complex_t dc_remove;
+	sdr_load_t load;	// time taken by each callback, filled in by the audio backend
+	guint64 clock;		// input samples processed so far
+
+	// commands from the GUI thread, taken in order at the start of each period
+	sdr_cmd_t cmd[SDR_CMD_RING];
+	volatile gint cmd_head;	// written only by sdr_command
+	volatile gint cmd_tail;	// written only by sdr_process
 	// jack parameters
 	guint size;  // periodsize
 	guint sample_rate;	// samplerate
 } sdr_data_t;
 
 sdr_data_t *sdr_new(gint fft_size);
-int sdr_process(sdr_data_t *sdr);
+int sdr_process(sdr_data_t *sdr, const gfloat *left, const gfloat *right);
 void sdr_destroy(sdr_data_t *sdr);
+gboolean sdr_decimate_setup(sdr_data_t *sdr, gint factor);
+sdr_rx_t *sdr_rx_new(sdr_data_t *sdr, gint taps, gint engine);
+void sdr_rx_set_demod(sdr_rx_t *rx, gint demod);
+void sdr_rx_filter_shape(sdr_rx_t *rx, gdouble lowpass, gdouble highpass, gfloat *bw, gfloat *centre);
+void sdr_rx_destroy(sdr_data_t *sdr, sdr_rx_t *rx);
+void sdr_rx_tune(sdr_rx_t *rx, guint sample_rate, gdouble freq);
+gboolean sdr_command(sdr_data_t *sdr, gint type, gint rx, gdouble value, guint64 when);
+void sdr_workers_start(sdr_data_t *sdr);
+void sdr_workers_stop(sdr_data_t *sdr);
 void fft_setup(sdr_data_t *sdr);
 void fft_teardown(sdr_data_t *sdr);
+gboolean fft_read(sdr_data_t *sdr, guint *pos, FFTW(complex) *dest);
 #endif
 
 /* vim: set noexpandtab ai ts=4 sw=4 tw=4: */
@@ -0,0 +1,476 @@
+/*  lysdr Software Defined Radio
+	(C) 2010-2011 Gordon JC Pearce MM0YEQ and others
+
+	spectrum.c
+	turn the input samples into waterfall rows, away from the GUI thread
+
+	This file is part of lysdr.
+
+	lysdr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	any later version.
+
+	lysdr is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with lysdr.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <math.h>
+#include <complex.h>
+#include <gtk/gtk.h>
+#include <string.h>
+#include "sdr.h"
+#include "spectrum.h"
+#include "colourmap.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static const gchar *window_names[] = { "hann", "hamming", "blackman-harris", "flat-top", "kaiser", NULL };
+static const gchar *hold_names[] = { "max", "mean", NULL };
+
+static gdouble bessel_i0(gdouble x) {
+	// modified Bessel function of the first kind, order 0, by its power series
+	gdouble sum = 1, term = 1;
+	gint k;
+	for (k = 1; term > 1e-12 * sum; k++) {
+		term *= (x / (2 * k)) * (x / (2 * k));
+		sum += term;
+	}
+	return sum;
+}
+
+static void spectrum_make_window(spectrum_t *spec, gint window, gdouble beta) {
+	// fill the window table; this is the only place the cosines get worked out
+	// every window is scaled to the same mean as Hamming, so the waterfall
+	// brightness doesn't jump when the window changes
+	gint i, n = spec->sdr->fft_size;
+	gdouble t, x, w, sum = 0;
+
+	for (i = 0; i < n; i++) {
+		t = 2.0 * M_PI * i / n;
+		switch (window) {
+			case WINDOW_HANN:
+				w = 0.5 - 0.5 * cos(t);
+				break;
+			case WINDOW_BLACKMAN_HARRIS:
+				w = 0.35875 - 0.48829 * cos(t) + 0.14128 * cos(2 * t) - 0.01168 * cos(3 * t);
+				break;
+			case WINDOW_FLAT_TOP:
+				w = 0.21557895 - 0.41663158 * cos(t) + 0.277263158 * cos(2 * t)
+					- 0.083578947 * cos(3 * t) + 0.006947368 * cos(4 * t);
+				break;
+			case WINDOW_KAISER:
+				x = 2.0 * i / n - 1;
+				w = bessel_i0(beta * sqrt(1 - x * x)) / bessel_i0(beta);
+				break;
+			case WINDOW_HAMMING:
+			default:
+				w = 0.54 - 0.46 * cos(t);
+				break;
+		}
+		spec->window[2 * i] = w;
+		sum += w;
+	}
+	for (i = 0; i < n; i++) {
+		spec->window[2 * i] *= 0.54 * n / sum;
+		spec->window[2 * i + 1] = spec->window[2 * i];
+	}
+	spec->window_type = window;
+	spec->beta = beta;
+}
+
+static void spectrum_map(gint *map, gint n, gint width, gdouble zoom, gdouble centre, gint sample_rate) {
+	// work out which of n bins, in display order, fall in each pixel of the view;
+	// a pixel narrower than a bin still gets the one it's in, so zooming in stretches the bins
+	gint x, lo, hi;
+	gdouble bins = n / zoom;	// bins across the whole view
+	gdouble first = n / 2 + centre * n / sample_rate - bins / 2 + 0.5;	// bins are centred on their frequency
+
+	for (x = 0; x < width; x++) {
+		lo = CLAMP(floor(first + x * bins / width), 0, n - 1);
+		hi = CLAMP(floor(first + (x + 1) * bins / width), lo + 1, n);
+		map[2 * x] = lo;
+		map[2 * x + 1] = hi;
+	}
+}
+
+static void spectrum_take_view(spectrum_t *spec) {
+	// copy the view the GUI asked for into the thread's own, and map it
+	g_mutex_lock(&spec->lock);
+	spec->width = spec->want_width;
+	spec->zoom = spec->want_zoom;
+	spec->centre = spec->want_centre;
+	spec->hold = spec->want_hold;
+	g_mutex_unlock(&spec->lock);
+	spectrum_map(spec->map, spec->sdr->fft_size, spec->width, spec->zoom, spec->centre, spec->sdr->sample_rate);
+}
+
+// 1 + log2(m) for m in [1, 2), good to about 0.005, so about 0.015dB; the
+// extra 1 comes off the exponent, by taking its bias as 128
+#define LOG2_C2 -0.34484843f
+#define LOG2_C1 2.02466578f
+#define LOG2_C0 -0.67487759f
+#define DB_PER_OCTAVE 3.01029996f	// 10*log10(2)
+
+static inline gfloat spectrum_db(gfloat p) {
+	// 10*log10(p) from the float's exponent and a quadratic in its mantissa
+	union { gfloat f; guint32 i; } u = { p };
+	gfloat e = (gint)((u.i >> 23) & 0xff) - 128;
+	u.i = (u.i & 0x7fffff) | 0x3f800000;
+	return DB_PER_OCTAVE * (e + (LOG2_C2 * u.f + LOG2_C1) * u.f + LOG2_C0);
+}
+
+static void spectrum_colour(spectrum_t *spec, const gfloat *power, guint32 *out, gint n, gfloat offset) {
+	// n powers to smoothed dB, and on to pixels through the colour map, over the
+	// range the last rows had; offset is the dB to add, to scale the sums to one FFT;
+	// silence stops at the history's floor, so it doesn't drag the mean down with it
+	gfloat *s = spec->smooth;
+	gfloat a = spec->fresh ? 1.0f : SPECTRUM_SMOOTH;
+	gfloat lo = spec->floor - SPECTRUM_FOOT;
+	gfloat scale = 255 / MAX(spec->ceiling - lo, SPECTRUM_RANGE);
+	gfloat sum = 0, peak = -1000, db, v;
+	gint i = 0, k;
+#if defined(__SSE2__)
+	__m128 va = _mm_set1_ps(a), vlo = _mm_set1_ps(lo), vscale = _mm_set1_ps(scale);
+	__m128 voff = _mm_set1_ps(offset), vdb = _mm_set1_ps(DB_PER_OCTAVE);
+	__m128 vsum = _mm_setzero_ps(), vpeak = _mm_set1_ps(-1000);
+	__m128 zero = _mm_setzero_ps(), top = _mm_set1_ps(255), bottom = _mm_set1_ps(HISTORY_FLOOR);
+	__m128i mant = _mm_set1_epi32(0x7fffff), one = _mm_set1_epi32(0x3f800000), bias = _mm_set1_epi32(128);
+	__m128 vp, ve, vm, vs;
+	__m128i bits;
+	gint idx[4] __attribute__((aligned(16)));
+	gfloat part[4] __attribute__((aligned(16)));
+
+	for (; i + 4 <= n; i += 4) {
+		bits = _mm_castps_si128(_mm_loadu_ps(power + i));
+		ve = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), bias));
+		vm = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, mant), one));
+		vp = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(LOG2_C2), vm), _mm_set1_ps(LOG2_C1)), vm), _mm_set1_ps(LOG2_C0));
+		vp = _mm_max_ps(_mm_add_ps(_mm_mul_ps(_mm_add_ps(ve, vp), vdb), voff), bottom);
+		vs = _mm_loadu_ps(s + i);
+		vs = _mm_add_ps(vs, _mm_mul_ps(va, _mm_sub_ps(vp, vs)));
+		_mm_storeu_ps(s + i, vs);
+		vsum = _mm_add_ps(vsum, vs);
+		vpeak = _mm_max_ps(vpeak, vs);
+		vs = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(vs, vlo), vscale), zero), top);
+		_mm_store_si128((__m128i *)idx, _mm_cvttps_epi32(vs));
+		for (k = 0; k < 4; k++)
+			out[i + k] = spec->lut[idx[k]];
+	}
+	_mm_store_ps(part, vsum);
+	sum = part[0] + part[1] + part[2] + part[3];
+	_mm_store_ps(part, vpeak);
+	for (k = 0; k < 4; k++)
+		peak = MAX(peak, part[k]);
+#endif
+	for (; i < n; i++) {
+		db = MAX(spectrum_db(power[i]) + offset, HISTORY_FLOOR);
+		s[i] += a * (db - s[i]);
+		sum += s[i];
+		peak = MAX(peak, s[i]);
+		v = CLAMP((s[i] - lo) * scale, 0, 255);
+		out[i] = spec->lut[(gint)v];
+	}
+
+	// the floor follows the mean, which is mostly noise, and the ceiling the peak
+	if (spec->fresh && !spec->ranged) {
+		spec->floor = sum / n;
+		spec->ceiling = peak;
+		spec->ranged = TRUE;
+	} else {
+		spec->floor += SPECTRUM_TRACK * (sum / n - spec->floor);
+		spec->ceiling += SPECTRUM_TRACK * (peak - spec->ceiling);
+	}
+	spec->fresh = FALSE;
+}
+
+static void spectrum_apply_window(sdr_real_t *x, const sdr_real_t *w, gint n) {
+	// multiply n interleaved reals by the window table, two or four at a time
+	gint i = 0;
+#if defined(__SSE2__) && defined(SDR_SINGLE)
+	for (; i + 4 <= n; i += 4)
+		_mm_storeu_ps(x + i, _mm_mul_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(w + i)));
+#elif defined(__SSE2__)
+	for (; i + 2 <= n; i += 2)
+		_mm_storeu_pd(x + i, _mm_mul_pd(_mm_loadu_pd(x + i), _mm_loadu_pd(w + i)));
+#endif
+	for (; i < n; i++)
+		x[i] *= w[i];
+}
+
+static void spectrum_segment(spectrum_t *spec) {
+	// window and transform one segment, and add its power to the average
+	sdr_data_t *sdr = spec->sdr;
+	fft_data_t *fft = sdr->fft;
+	sdr_real_t *out = (sdr_real_t *)fft->out;
+	int i;
+
+	spectrum_apply_window((sdr_real_t *)fft->windowed, spec->window, 2 * sdr->fft_size);
+	FFTW(execute)(fft->plan);
+
+	for (i = 0; i < sdr->fft_size; i++)
+		spec->power[i] += out[2 * i] * out[2 * i] + out[2 * i + 1] * out[2 * i + 1];
+	spec->segments++;
+}
+
+static void spectrum_row(spectrum_t *spec, guchar *data) {
+	// colour in the averaged power, lowest frequency first, a pixel for each run of bins in the map
+	sdr_data_t *sdr = spec->sdr;
+	int x, b, p, hi;
+	gfloat power;
+
+	hi = sdr->fft_size/2;
+
+	for (x = 0; x < spec->width; x++) {
+		power = 0;
+		for (b = spec->map[2 * x]; b < spec->map[2 * x + 1]; b++) {
+			p = b < hi ? b + hi : b - hi;	// display order starts at -sample_rate/2, FFT order at 0
+			if (spec->hold == HOLD_MAX)
+				power = MAX(power, spec->power[p]);
+			else
+				power += spec->power[p];
+		}
+		if (spec->hold == HOLD_MEAN)
+			power /= spec->map[2 * x + 1] - spec->map[2 * x];
+		spec->pixel[x] = power;
+	}
+	spectrum_colour(spec, spec->pixel, (guint32 *)data, spec->width, -10 * log10f(spec->segments));
+}
+
+static gpointer spectrum_thread(gpointer pspec) {
+	// transform every segment as it arrives, and make a row from each batch
+	spectrum_t *spec = (spectrum_t *)pspec;
+	sdr_data_t *sdr = spec->sdr;
+	guchar *row;
+	gint serial = 0;	// spectrum_new built the first window and map
+	gint view = 0;
+	gint window;
+	gdouble beta;
+
+	while (!g_atomic_int_get(&spec->quit)) {
+		if (serial != g_atomic_int_get(&spec->window_serial)) {
+			serial = g_atomic_int_get(&spec->window_serial);
+			g_mutex_lock(&spec->lock);
+			window = spec->want_window;
+			beta = spec->want_beta;
+			g_mutex_unlock(&spec->lock);
+			spectrum_make_window(spec, window, beta);
+		}
+		if (view != g_atomic_int_get(&spec->view_serial)) {
+			view = g_atomic_int_get(&spec->view_serial);
+			spectrum_take_view(spec);
+			spec->fresh = TRUE;		// the smoothing starts again for the new pixels
+		}
+
+		while (fft_read(sdr, &spec->pos, sdr->fft->windowed)) {
+			spec->pos += spec->hop;
+			spectrum_segment(spec);
+			if (spec->segments < spec->average)
+				continue;
+
+			if (spec->history)
+				history_append(spec->history, spec->power, sdr->fft_size, 1.0f / spec->segments, g_get_real_time());
+
+			row = g_async_queue_try_pop(spec->spare);
+			if (!row)
+				row = g_async_queue_try_pop(spec->rows);	// the GUI has fallen behind, drop its oldest row
+			if (row) {
+				spectrum_row(spec, row);
+				spec->row_width[(row - spec->pool) / (SPECTRUM_MAX_WIDTH * 4)] = spec->width;
+				g_async_queue_push(spec->rows, row);
+			}
+			memset(spec->power, 0, sizeof(gfloat) * sdr->fft_size);
+			spec->segments = 0;
+		}
+
+		g_usleep(spec->nap);	// until about the next segment is due
+	}
+	return NULL;
+}
+
+spectrum_t *spectrum_new(sdr_data_t *sdr, gint interval, gint overlap, gint average, history_t *hist) {
+	// start the spectrum thread; call fft_setup first
+	// segments overlap by overlap percent; every average segments make a row,
+	// or if average is 0, enough segments for about one row every interval ms;
+	// every row is kept in hist too, unless it's NULL
+	spectrum_t *spec;
+	int i;
+
+	spec = g_new0(spectrum_t, 1);
+	spec->sdr = sdr;
+	spec->hop = MAX(1, sdr->fft_size * (100 - CLAMP(overlap, 0, 99)) / 100);
+	spec->average = average;
+	spec->history = hist;
+	if (spec->average <= 0)
+		spec->average = MAX(1, (gint64)sdr->sample_rate * interval / 1000 / spec->hop);
+	spec->nap = CLAMP((gint64)spec->hop * 1000000 / MAX(sdr->sample_rate, 1), 1000, interval * 1000);
+	spec->pos = g_atomic_int_get(&sdr->fft->written);
+	spec->power = g_new0(gfloat, sdr->fft_size);
+	g_mutex_init(&spec->lock);
+	spec->window = g_new0(sdr_real_t, 2 * sdr->fft_size);
+	spec->want_window = WINDOW_HAMMING;
+	spec->want_beta = SPECTRUM_KAISER_BETA;
+	spectrum_make_window(spec, spec->want_window, spec->want_beta);
+	spec->want_width = MIN(sdr->fft_size, SPECTRUM_MAX_WIDTH);
+	spec->want_zoom = 1;
+	spec->want_hold = HOLD_MAX;
+	spec->map = g_new(gint, 2 * SPECTRUM_MAX_WIDTH);
+	spectrum_take_view(spec);
+	spec->pixel = g_new0(gfloat, SPECTRUM_MAX_WIDTH);
+	spec->smooth = g_new0(gfloat, SPECTRUM_MAX_WIDTH);
+	spec->fresh = TRUE;
+	for (i = 0; i < 256; i++)
+		spec->lut[i] = 0xff000000 | ((guint32)colourmap[i] >> 8);	// colourmap is RGBx, cairo wants ARGB
+	spec->pool = g_new0(guchar, SPECTRUM_ROWS * SPECTRUM_MAX_WIDTH * 4);
+	spec->rows = g_async_queue_new();
+	spec->spare = g_async_queue_new();
+	for (i = 0; i < SPECTRUM_ROWS; i++)
+		g_async_queue_push(spec->spare, spec->pool + i * SPECTRUM_MAX_WIDTH * 4);
+
+	spec->thread = g_thread_new("spectrum", spectrum_thread, spec);
+	return spec;
+}
+
+void spectrum_destroy(spectrum_t *spec) {
+	g_atomic_int_set(&spec->quit, TRUE);
+	g_thread_join(spec->thread);
+	g_async_queue_unref(spec->rows);
+	g_async_queue_unref(spec->spare);
+	g_free(spec->pool);
+	g_free(spec->power);
+	g_free(spec->window);
+	g_free(spec->map);
+	g_free(spec->history_map);
+	g_free(spec->pixel);
+	g_free(spec->smooth);
+	g_mutex_clear(&spec->lock);
+	g_free(spec);
+}
+
+guchar *spectrum_get_row(spectrum_t *spec, gint *width) {
+	// the oldest finished row and its width, or NULL if there isn't one; never blocks
+	guchar *row = g_async_queue_try_pop(spec->rows);
+
+	if (row)
+		*width = spec->row_width[(row - spec->pool) / (SPECTRUM_MAX_WIDTH * 4)];
+	return row;
+}
+
+void spectrum_release_row(spectrum_t *spec, guchar *row) {
+	// hand a row back once it's been drawn
+	g_async_queue_push(spec->spare, row);
+}
+
+void spectrum_set_window(spectrum_t *spec, gint window, gdouble beta) {
+	// ask the spectrum thread to switch windows before its next row
+	g_mutex_lock(&spec->lock);
+	spec->want_window = window;
+	spec->want_beta = beta;
+	g_mutex_unlock(&spec->lock);
+	g_atomic_int_inc(&spec->window_serial);
+}
+
+void spectrum_set_view(spectrum_t *spec, gint width, gdouble zoom, gdouble centre) {
+	// ask for rows width pixels wide covering sample_rate/zoom Hz around centre
+	g_mutex_lock(&spec->lock);
+	spec->want_width = CLAMP(width, 1, SPECTRUM_MAX_WIDTH);
+	spec->want_zoom = MAX(zoom, 1);
+	spec->want_centre = centre;
+	g_mutex_unlock(&spec->lock);
+	g_atomic_int_inc(&spec->view_serial);
+}
+
+void spectrum_set_hold(spectrum_t *spec, gint hold) {
+	// max hold keeps narrow signals visible when zoomed out, mean keeps the noise floor down
+	g_mutex_lock(&spec->lock);
+	spec->want_hold = hold;
+	g_mutex_unlock(&spec->lock);
+	g_atomic_int_inc(&spec->view_serial);
+}
+
+void spectrum_history_row(spectrum_t *spec, const guchar *q, gint bins, guchar *row, gint width, gdouble zoom, gdouble centre) {
+	// colour a row from the history for a view of the band, over the range the live rows have now
+	// the map is only worked out again when the view changes, not for every row
+	gint *map;
+	guint32 lut[256], *out = (guint32 *)row;
+	gfloat lo = spec->floor - SPECTRUM_FOOT;
+	gfloat scale = 255 / MAX(spec->ceiling - lo, SPECTRUM_RANGE);
+	gint x, b;
+	guchar peak;
+
+	for (x = 0; x < 256; x++)
+		lut[x] = spec->lut[(gint)CLAMP((HISTORY_FLOOR + x * HISTORY_STEP - lo) * scale, 0, 255)];
+	if (width != spec->history_width) {
+		spec->history_map = g_renew(gint, spec->history_map, 2 * width);
+		spec->history_width = width;
+		spec->history_bins = 0;
+	}
+	map = spec->history_map;
+	if (bins != spec->history_bins || zoom != spec->history_zoom || centre != spec->history_centre) {
+		spectrum_map(map, bins, width, zoom, centre, spec->sdr->sample_rate);
+		spec->history_bins = bins;
+		spec->history_zoom = zoom;
+		spec->history_centre = centre;
+	}
+	for (x = 0; x < width; x++) {
+		peak = 0;
+		for (b = map[2 * x]; b < map[2 * x + 1]; b++)
+			peak = MAX(peak, q[b]);
+		out[x] = lut[peak];
+	}
+}
+
+void spectrum_render(spectrum_t *spec, guchar *row) {
+	// one segment straight to one row, as the thread does with an average of 1
+	// the segment must already be in sdr->fft->windowed; this is for lysdr-bench,
+	// which never fills the ring, so the thread can't be using the same buffers
+	memset(spec->power, 0, sizeof(gfloat) * spec->sdr->fft_size);
+	spec->segments = 0;
+	spectrum_segment(spec);
+	spectrum_row(spec, row);
+}
+
+gboolean spectrum_parse_window(const gchar *name, gint *window, gdouble *beta) {
+	// window name as given to --window; kaiser can take a beta, as in kaiser:6
+	gint i;
+	gsize len = strcspn(name, ":");
+
+	for (i = 0; window_names[i]; i++) {
+		if (len == strlen(window_names[i]) && !g_ascii_strncasecmp(name, window_names[i], len))
+			break;
+	}
+	if (!window_names[i])
+		return FALSE;
+	*window = i;
+	*beta = SPECTRUM_KAISER_BETA;
+	if (name[len] == ':') {
+		if (i != WINDOW_KAISER)
+			return FALSE;
+		*beta = g_ascii_strtod(name + len + 1, NULL);
+		if (*beta <= 0)
+			return FALSE;
+	}
+	return TRUE;
+}
+
+gboolean spectrum_parse_hold(const gchar *name, gint *hold) {
+	// hold name as given to --hold
+	gint i;
+
+	for (i = 0; hold_names[i]; i++) {
+		if (!g_ascii_strcasecmp(name, hold_names[i])) {
+			*hold = i;
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+/* vim: set noexpandtab ai ts=4 sw=4 tw=4: */
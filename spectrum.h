@@ -0,0 +1,98 @@
+/*  lysdr Software Defined Radio
+	(C) 2010-2011 Gordon JC Pearce MM0YEQ and others
+
+	spectrum.h
+
+	This file is part of lysdr.
+
+	lysdr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	any later version.
+
+	lysdr is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with lysdr.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SPECTRUM_H
+#define __SPECTRUM_H
+
+#include <gtk/gtk.h>
+#include "sdr.h"
+#include "history.h"
+
+#define SPECTRUM_ROWS 8		// rows in flight between the spectrum thread and the GUI
+#define SPECTRUM_KAISER_BETA 8.6	// about the sidelobes of Blackman-Harris
+#define SPECTRUM_MAX_WIDTH 4096	// widest row, in pixels
+#define SPECTRUM_SMOOTH 0.5f	// weight of each new row in a pixel's running dB
+#define SPECTRUM_TRACK 0.05f	// and of each row's mean and peak in the colour range
+#define SPECTRUM_FOOT 6			// dB of the colour map below the mean, for the noise
+#define SPECTRUM_RANGE 40		// dB the colour map spans at the least
+
+enum spectrum_window { WINDOW_HANN, WINDOW_HAMMING, WINDOW_BLACKMAN_HARRIS, WINDOW_FLAT_TOP, WINDOW_KAISER };
+enum spectrum_hold { HOLD_MAX, HOLD_MEAN };	// how the bins that share a pixel are combined
+
+typedef struct {
+	sdr_data_t *sdr;
+	GThread *thread;
+	GAsyncQueue *rows;		// finished rows, oldest first, ready to blit
+	GAsyncQueue *spare;		// rows the GUI has finished with
+	guchar *pool;			// storage for all SPECTRUM_ROWS rows
+	gint row_width[SPECTRUM_ROWS];	// pixels in each row of the pool
+	gfloat *power;			// Welch sum of |X|^2 for each bin, FFT order
+	gint segments;			// how many are in the sum so far
+	gint average;			// segments per row
+	gint hop;				// samples between segment starts
+	guint pos;				// stream position of the next segment
+	gulong nap;				// microseconds to sleep when caught up
+	sdr_real_t *window;		// window table, each value twice to match I and Q
+	gint window_type;
+	gdouble beta;			// for the Kaiser window
+	gint width;				// pixels in a row
+	gdouble zoom;			// the view is sample_rate/zoom wide...
+	gdouble centre;			// ...centred this many Hz from the middle of the band
+	gint hold;
+	gint *map;				// first and one past the last bin, in display order, of each pixel
+	// the settings the GUI asked for last; the thread copies them into the
+	// fields above when a serial changes, and only ever draws with its copy
+	GMutex lock;
+	gint want_window;
+	gdouble want_beta;
+	volatile gint window_serial;	// bumped when the GUI picks a new window
+	gint want_width;
+	gdouble want_zoom, want_centre;
+	gint want_hold;
+	volatile gint view_serial;	// bumped when the GUI changes the view or hold
+	history_t *history;		// where every row is kept, if anywhere; fixed before the thread starts
+	gint *history_map;		// the GUI's map for history rows, and the view it was made for
+	gint history_width, history_bins;
+	gdouble history_zoom, history_centre;
+	gfloat *pixel;			// power of each pixel in the row being made
+	gfloat *smooth;			// running dB of each pixel
+	gboolean fresh;			// the running dB has to start again
+	gfloat floor, ceiling;	// running mean and peak dB of the rows
+	gboolean ranged;		// floor and ceiling have been set
+	guint32 lut[256];		// the colour map as native ARGB32
+	volatile gint quit;
+} spectrum_t;
+
+spectrum_t *spectrum_new(sdr_data_t *sdr, gint interval, gint overlap, gint average, history_t *hist);
+void spectrum_destroy(spectrum_t *spec);
+guchar *spectrum_get_row(spectrum_t *spec, gint *width);
+void spectrum_release_row(spectrum_t *spec, guchar *row);
+void spectrum_set_window(spectrum_t *spec, gint window, gdouble beta);
+void spectrum_set_view(spectrum_t *spec, gint width, gdouble zoom, gdouble centre);
+void spectrum_set_hold(spectrum_t *spec, gint hold);
+void spectrum_history_row(spectrum_t *spec, const guchar *q, gint bins, guchar *row, gint width, gdouble zoom, gdouble centre);
+void spectrum_render(spectrum_t *spec, guchar *row);
+gboolean spectrum_parse_window(const gchar *name, gint *window, gdouble *beta);
+gboolean spectrum_parse_hold(const gchar *name, gint *hold);
+
+#endif
+
+/* vim: set noexpandtab ai ts=4 sw=4 tw=4: */
@@ -48,11 +48,25 @@
 static GtkWidgetClass *parent_class = NULL;
 G_DEFINE_TYPE (SDRWaterfall, sdr_waterfall, GTK_TYPE_DRAWING_AREA);
 
+// frequencies are offsets from the centre in Hz, pixels count along the frequency axis
+static gdouble wf_hz_per_pixel(SDRWaterfall *wf) {
+    return wf->sample_rate / (wf->zoom * wf->width);
+}
+
+static gint wf_freq_to_pixel(SDRWaterfall *wf, gdouble freq) {
+    return wf->width / 2 + floor((freq - wf->view_centre) / wf_hz_per_pixel(wf));
+}
+
+static gdouble wf_pixel_to_freq(SDRWaterfall *wf, gint x) {
+    return wf->view_centre + (x - wf->width / 2) * wf_hz_per_pixel(wf);
+}
+
 static gboolean sdr_waterfall_motion_notify (GtkWidget *widget, GdkEventMotion *event);
 static gboolean sdr_waterfall_expose(GtkWidget *widget, GdkEventExpose *event);
 static gboolean sdr_waterfall_button_press(GtkWidget *widget, GdkEventButton *event);
 static gboolean sdr_waterfall_button_release(GtkWidget *widget, GdkEventButton *event);
 static gboolean sdr_waterfall_scroll(GtkWidget *widget, GdkEventScroll *event);
+static gboolean sdr_waterfall_configure(GtkWidget *widget, GdkEventConfigure *event);
 static void sdr_waterfall_realize(GtkWidget *widget);
 static void sdr_waterfall_unrealize(GtkWidget *widget);
 void sdr_waterfall_set_lowpass(SDRWaterfall *wf, gdouble value);
@@ -70,6 +84,7 @@ static void sdr_waterfall_class_init (SDRWaterfallClass *class) {
     widget_class->button_release_event = sdr_waterfall_button_release;
     widget_class->motion_notify_event = sdr_waterfall_motion_notify;
     widget_class->scroll_event = sdr_waterfall_scroll;
+    widget_class->configure_event = sdr_waterfall_configure;
 
     g_type_class_add_private (class, sizeof (SDRWaterfallPrivate));
 
@@ -83,42 +98,60 @@ static void sdr_waterfall_init (SDRWaterfall *wf) {
     priv->drag = P_NONE;
     priv->scroll_pos = 0;
     wf->centre_freq = 0;
+    wf->markers = 0;
+    wf->marker_active = 0;
+    wf->zoom = 1;
+    wf->view_centre = 0;
+    wf->view_serial = 0;
 }
 
 void sdr_waterfall_filter_cursors(SDRWaterfall *wf) {
     SDRWaterfallPrivate *priv = SDR_WATERFALL_GET_PRIVATE(wf);
-    gint width = wf->width;
+    gdouble hz = wf_hz_per_pixel(wf);
 
     // FIXME - work out best place to put the enum
     // FIXME - use accessors for filters rather than gtk_adjustment_get_value
     switch(wf->mode) {
         case 0:
-            priv->lp_pos = priv->cursor_pos - (width*(gtk_adjustment_get_value(wf->lp_tune)/wf->sample_rate));
-            priv->hp_pos = priv->cursor_pos - (width*(gtk_adjustment_get_value(wf->hp_tune)/wf->sample_rate));
+            priv->lp_pos = priv->cursor_pos - gtk_adjustment_get_value(wf->lp_tune) / hz;
+            priv->hp_pos = priv->cursor_pos - gtk_adjustment_get_value(wf->hp_tune) / hz;
             break;
         case 1:
-            priv->lp_pos = priv->cursor_pos + (width*(gtk_adjustment_get_value(wf->lp_tune)/wf->sample_rate));
-            priv->hp_pos = priv->cursor_pos + (width*(gtk_adjustment_get_value(wf->hp_tune)/wf->sample_rate));
+            priv->lp_pos = priv->cursor_pos + gtk_adjustment_get_value(wf->lp_tune) / hz;
+            priv->hp_pos = priv->cursor_pos + gtk_adjustment_get_value(wf->hp_tune) / hz;
             break;
     }
 
 }
 
-static void sdr_waterfall_realize(GtkWidget *widget) {
-    // here we handle things that must happen once the widget has a size
-    SDRWaterfall *wf;
-//    GtkAllocation *allocation;
-    cairo_t *cr;
-    gint i, j, scale, width;
-    char s[10];
+static void sdr_waterfall_view_changed(SDRWaterfall *wf) {
+    // keep the view inside the band, and move everything drawn in pixels to match
+    SDRWaterfallPrivate *priv = SDR_WATERFALL_GET_PRIVATE(wf);
+    gdouble edge = wf->sample_rate * (0.5 - 0.5 / wf->zoom);
 
-    g_return_if_fail(SDR_IS_WATERFALL(widget));
+    wf->view_centre = CLAMP(wf->view_centre, -edge, edge);
+    priv->cursor_pos = wf_freq_to_pixel(wf, gtk_adjustment_get_value(wf->tuning));
+    sdr_waterfall_filter_cursors(wf);
+    sdr_waterfall_set_scale(GTK_WIDGET(wf), wf->centre_freq);
+    wf->view_serial++;
+    gtk_widget_queue_draw(GTK_WIDGET(wf));
+}
 
-    wf = SDR_WATERFALL(widget);
-    SDRWaterfallPrivate *priv = SDR_WATERFALL_GET_PRIVATE(wf);
+static void sdr_waterfall_free(SDRWaterfall *wf) {
+    // drop everything sized to the widget
+    cairo_destroy(wf->pixmap_cr);
+    g_object_unref(wf->pixmap); // we should definitely have a pixmap
+    cairo_surface_destroy(wf->image);
+    if (wf->scale) // we might not have a scale
+        g_object_unref(wf->scale);
+    wf->scale = NULL;
+}
 
-    // chain up so we even *have* the size;
-    GTK_WIDGET_CLASS(parent_class)->realize(widget);
+static void sdr_waterfall_resize(GtkWidget *widget) {
+    // (re)make the image, pixmap and scale to fit the allocation
+    SDRWaterfall *wf = SDR_WATERFALL(widget);
+    SDRWaterfallPrivate *priv = SDR_WATERFALL_GET_PRIVATE(wf);
+    gint width;
 
     // save width and height to clamp rendering size
     // this just segfaults
@@ -138,37 +171,60 @@ static void sdr_waterfall_realize(GtkWidget *widget) {
 	wf->wf_height = widget->allocation.width - SCALE_WIDTH;
 	break;
     }
-    wf->width = width;
-
-    // FIXME we do this a lot, maybe it should be a function
-    // maybe we don't need it, since we poke the tuning adjustment
-    priv->cursor_pos = width * (0.5+(gtk_adjustment_get_value(wf->tuning)/wf->sample_rate));
-    // FIXME investigate cairo surfaces and speed
-    wf->pixmap = gdk_pixmap_new(gtk_widget_get_window(widget), wf_swap(width, wf->wf_height), -1);
-
-    // clear the waterfall pixmap to black
-    // not sure if there's a better way to do this
-    cr = gdk_cairo_create (wf->pixmap);
-    //cairo_rectangle(cr, 0, 0, wf_remap(width, wf->wf_height));
-    cairo_rectangle(cr, wf_rectangle(0, 0, width, wf->wf_height));
-    cairo_set_source_rgb(cr, 0, 0, 0);
-    cairo_paint(cr);
-    cairo_destroy(cr);
+    wf->width = MAX(width, 1);
+    wf->wf_height = MAX(wf->wf_height, 1);
+    priv->scroll_pos = 0;
+
+    // a new image surface is already black; copy all of it across once
+    wf->image = cairo_image_surface_create(CAIRO_FORMAT_RGB24, wf_swap(wf->width, wf->wf_height));
+    wf->pixmap = gdk_pixmap_new(gtk_widget_get_window(widget), wf_swap(wf->width, wf->wf_height), -1);
+    wf->pixmap_cr = gdk_cairo_create(wf->pixmap);
+    cairo_set_source_surface(wf->pixmap_cr, wf->image, 0, 0);
+    cairo_paint(wf->pixmap_cr);
+
+    sdr_waterfall_view_changed(wf);
+}
+
+static void sdr_waterfall_realize(GtkWidget *widget) {
+    // here we handle things that must happen once the widget has a size
+    SDRWaterfall *wf;
+
+    g_return_if_fail(SDR_IS_WATERFALL(widget));
 
-    sdr_waterfall_set_scale(widget, wf->centre_freq);
+    wf = SDR_WATERFALL(widget);
+    SDRWaterfallPrivate *priv = SDR_WATERFALL_GET_PRIVATE(wf);
+
+    // chain up so we even *have* the size;
+    GTK_WIDGET_CLASS(parent_class)->realize(widget);
 
     g_mutex_init(&priv->mutex);
+    sdr_waterfall_resize(widget);
     gtk_adjustment_value_changed(wf->tuning);
 }
 
+static gboolean sdr_waterfall_configure(GtkWidget *widget, GdkEventConfigure *event) {
+    // the window has changed size, so the rows have a new width
+    SDRWaterfall *wf = SDR_WATERFALL(widget);
+    SDRWaterfallPrivate *priv = SDR_WATERFALL_GET_PRIVATE(wf);
+
+    gint width = (wf->orientation == WF_O_VERTICAL) ? event->width : event->height;
+    gint height = (wf->orientation == WF_O_VERTICAL) ? event->height - SCALE_HEIGHT : event->width - SCALE_WIDTH;
+
+    if (width == wf->width && height == wf->wf_height)
+        return TRUE;
+    g_mutex_lock(&priv->mutex);
+    sdr_waterfall_free(wf);
+    sdr_waterfall_resize(widget);
+    g_mutex_unlock(&priv->mutex);
+    return TRUE;
+}
+
 static void sdr_waterfall_unrealize(GtkWidget *widget) {
     // ensure that the pixel buffer is freed
     SDRWaterfall *wf = SDR_WATERFALL(widget);
     SDRWaterfallPrivate *priv = SDR_WATERFALL_GET_PRIVATE(wf);
 
-    g_object_unref(wf->pixmap); // we should definitely have a pixmap
-    if (wf->scale) // we might not have a scale
-        g_object_unref(wf->scale);
+    sdr_waterfall_free(wf);
 
     g_mutex_clear(&priv->mutex);
     GTK_WIDGET_CLASS(parent_class)->unrealize(widget);
@@ -178,9 +234,8 @@ static void sdr_waterfall_tuning_changed(GtkWidget *widget, gpointer *p) {
     // if the tuning adjustment changes, ensure the pointer is recalculated
     SDRWaterfall *wf = SDR_WATERFALL(p);
     SDRWaterfallPrivate *priv = SDR_WATERFALL_GET_PRIVATE(wf);
-    int width = wf->width;
     gdouble value = gtk_adjustment_get_value(wf->tuning);   // FIXME - get from *widget?
-    priv->cursor_pos = width * (0.5+(value/wf->sample_rate));
+    priv->cursor_pos = wf_freq_to_pixel(wf, value);
     // need to update the filter positions too
     //priv->lp_pos = priv->cursor_pos - (width*(wf->lp_tune->value/wf->sample_rate));
     //priv->hp_pos = priv->cursor_pos - (width*(wf->hp_tune->value/wf->sample_rate));
@@ -240,13 +295,22 @@ SDRWaterfall *sdr_waterfall_new(GtkAdjustment *tuning, GtkAdjustment *lp_tune, G
 void sdr_waterfall_set_scale(GtkWidget *widget, gint centre_freq) {
     // draw the scale to a handy pixmap
     SDRWaterfall *wf = SDR_WATERFALL(widget);
+    static const gint steps[] = { 1, 2, 5 };
     gint width = wf->width;
     cairo_t *cr;
-    gint i, j, scale;
+    gint i, j, first, last, tick, places;
     gchar s[10];
+    gdouble hz = wf_hz_per_pixel(wf);
 
     wf->centre_freq = centre_freq;
 
+    // the closest ticks, in 1-2-5 steps, that leave room for the labels
+    for (i = 0; (tick = SCALE_TICK * steps[i % 3] * (gint)pow(10, i / 3)) / hz < SCALE_SPACING; i++)
+        ;
+    places = tick < 1000 ? 4 : 3;
+    first = ceil(wf_pixel_to_freq(wf, 0) / tick) * tick;
+    last = wf_pixel_to_freq(wf, width) + 1;
+
     if (!wf->scale) {
 	switch (wf->orientation) {
 	case WF_O_VERTICAL:
@@ -272,17 +336,15 @@ void sdr_waterfall_set_scale(GtkWidget *widget, gint centre_freq) {
 	cairo_stroke(cr);
 	cairo_set_line_width(cr, 1);
 
-	scale = (trunc(wf->sample_rate/SCALE_TICK)+1)*SCALE_TICK;
-
-	for (i=-scale; i<scale; i+=SCALE_TICK) {  // FIXME hardcoded
-	    j = width * (0.5+((double)i/wf->sample_rate));
+	for (i = first; i < last; i += tick) {
+	    j = wf_freq_to_pixel(wf, i);
 	    cairo_set_source_rgb(cr, 1, 0, 0);
 	    cairo_move_to(cr, 0.5+j, 0);
 	    cairo_line_to(cr, 0.5+j, 8);
 	    cairo_stroke(cr);
 	    cairo_move_to(cr, j-10, 18);
 	    cairo_set_source_rgb(cr, .75, .75, .75);
-	    sprintf(s, "%4.3f", (wf->centre_freq/1000000.0f)+(i/1000000.0f));
+	    sprintf(s, "%4.*f", places, (wf->centre_freq/1000000.0f)+(i/1000000.0f));
 	    cairo_show_text(cr,s);
 	}
 	break;
@@ -298,17 +360,15 @@ void sdr_waterfall_set_scale(GtkWidget *widget, gint centre_freq) {
 	cairo_stroke(cr);
 	cairo_set_line_width(cr, 1);
 
-	scale = (trunc(wf->sample_rate/SCALE_TICK)+1)*SCALE_TICK;
-
-	for (i=-scale; i<scale; i+=SCALE_TICK) {  // FIXME hardcoded
-	    j = width * (0.5+((double)i/wf->sample_rate));
+	for (i = first; i < last; i += tick) {
+	    j = wf_freq_to_pixel(wf, i);
 	    cairo_set_source_rgb(cr, 1, 0, 0);
 	    cairo_move_to(cr, 0, j);
 	    cairo_line_to(cr, 8, j);
 	    cairo_stroke(cr);
 	    cairo_move_to(cr, 12, j+4);
 	    cairo_set_source_rgb(cr, .75, .75, .75);
-	    sprintf(s, "%4.3f", (wf->centre_freq/1000000.0f)+(i/1000000.0f));
+	    sprintf(s, "%4.*f", places, (wf->centre_freq/1000000.0f)+(i/1000000.0f));
 	    cairo_show_text(cr,s);
 	}
 	break;
@@ -345,7 +405,7 @@ static gboolean sdr_waterfall_motion_notify (GtkWidget *widget, GdkEventMotion *
     }
     if (priv->drag == P_TUNING) {
         // drag cursor to tune
-        value = ((float)x/width-0.5)*wf->sample_rate;
+        value = wf_pixel_to_freq(wf, x);
         sdr_waterfall_set_tuning(wf, value);
         prelight = P_TUNING;
         dirty = TRUE;
@@ -366,7 +426,7 @@ static gboolean sdr_waterfall_motion_notify (GtkWidget *widget, GdkEventMotion *
         } else {
             offset = x - priv->cursor_pos;
         }
-        value = ((float)offset/width)*wf->sample_rate;
+        value = offset * wf_hz_per_pixel(wf);
         sdr_waterfall_set_lowpass(wf, (float)value);
         prelight = P_LOWPASS;
     }
@@ -377,11 +437,17 @@ static gboolean sdr_waterfall_motion_notify (GtkWidget *widget, GdkEventMotion *
         } else {
             offset = x - priv->cursor_pos;
         }
-        value = ((float)offset/width)*wf->sample_rate;
+        value = offset * wf_hz_per_pixel(wf);
         sdr_waterfall_set_highpass(wf, (float)value);
         prelight = P_HIGHPASS;
     }
 
+    if (priv->drag == P_PAN) {
+        // middle-drag to slide the band along under a zoomed view
+        wf->view_centre = priv->pan_centre - (x - priv->click_pos) * wf_hz_per_pixel(wf);
+        sdr_waterfall_view_changed(wf);
+    }
+
     // redraw if the prelight has changed
     if (prelight != priv->prelight) {
         dirty = TRUE;
@@ -408,11 +474,17 @@ static gboolean sdr_waterfall_button_press(GtkWidget *widget, GdkEventButton *ev
             // clicking off the cursor should jump the tuning to wherever we clicked
             if (priv->prelight == P_NONE) {
                 priv->prelight = P_TUNING;
-                sdr_waterfall_set_tuning(wf, ((float)x/wf->width-0.5)*wf->sample_rate);
+                sdr_waterfall_set_tuning(wf, wf_pixel_to_freq(wf, x));
             }
             priv->drag = priv->prelight;    // maybe the cursor is on something
             priv->click_pos = x;
             break;
+        case 2:
+            // middle-click to pan
+            priv->drag = P_PAN;
+            priv->click_pos = x;
+            priv->pan_centre = wf->view_centre;
+            break;
         case 3:
             // right-click for bandspread tuning
             priv->prelight = P_TUNING;
@@ -441,6 +513,20 @@ static gboolean sdr_waterfall_scroll(GtkWidget *widget, GdkEventScroll *event) {
     SDRWaterfall *wf = SDR_WATERFALL(widget);
     float tuning = gtk_adjustment_get_value(wf->tuning);
     float step;
+    gint x = (wf->orientation == WF_O_VERTICAL) ? event->x : (wf->width-event->y);
+    gdouble freq;
+
+    if (event->state & GDK_CONTROL_MASK) {
+        // ctrl-scroll zooms in and out, keeping the frequency under the pointer still
+        freq = wf_pixel_to_freq(wf, x);
+        if (event->direction == GDK_SCROLL_UP)
+            wf->zoom = MIN(wf->zoom * 2, WF_MAX_ZOOM);
+        else if (event->direction == GDK_SCROLL_DOWN)
+            wf->zoom = MAX(wf->zoom / 2, 1);
+        wf->view_centre = freq - (x - wf->width / 2) * wf_hz_per_pixel(wf);
+        sdr_waterfall_view_changed(wf);
+        return TRUE;
+    }
 
     if (event->state & GDK_MOD1_MASK) {
         step = 10000.0;
@@ -476,6 +562,8 @@ static gboolean sdr_waterfall_expose(GtkWidget *widget, GdkEventExpose *event) {
     int width = wf->width;
     int height = wf->wf_height;
     int cursor;
+    int i;
+    char s[4];
 
     cairo_t *cr = gdk_cairo_create (gtk_widget_get_window(widget));
 
@@ -495,13 +583,27 @@ static gboolean sdr_waterfall_expose(GtkWidget *widget, GdkEventExpose *event) {
     cairo_rectangle(cr, wf_rectangle(0, 0, width, height));
     cairo_clip(cr);
 
+    // the oldest row goes at the top; repeating the pixmap unwraps the ring in one pass
     g_mutex_lock(&priv->mutex);
         gdk_cairo_set_source_pixmap(cr, wf->pixmap, wf_remap(0, -priv->scroll_pos));
+        cairo_pattern_set_extend(cairo_get_source(cr), CAIRO_EXTEND_REPEAT);
         cairo_paint(cr);
-        gdk_cairo_set_source_pixmap(cr, wf->pixmap, wf_remap(0, height-priv->scroll_pos));
-	cairo_paint(cr);
     g_mutex_unlock(&priv->mutex);
 
+    // the other receivers, numbered from 1 like their jack ports
+    cairo_set_line_width(cr, 1);
+    for (i = 0; i < wf->markers; i++) {
+        if (i == wf->marker_active) continue;
+        cursor = wf_freq_to_pixel(wf, wf->marker[i]);
+        cairo_set_source_rgba(cr, 0, 1, 1, 0.5);
+        cairo_move_to(cr, wf_transpose(0.5f+cursor, 0));
+        cairo_line_to(cr, wf_transpose(0.5f+cursor, height));
+        cairo_stroke(cr);
+        sprintf(s, "%d", i + 1);
+        cairo_move_to(cr, wf_transpose(cursor+3, 12));
+        cairo_show_text(cr, s);
+    }
+
     // cursor is translucent when "off", opaque when prelit
     cursor = priv->cursor_pos;
     if (priv->prelight == P_TUNING) {
@@ -550,39 +652,39 @@ static gboolean sdr_waterfall_expose(GtkWidget *widget, GdkEventExpose *event) {
     return FALSE;
 }
 
-void sdr_waterfall_update(GtkWidget *widget, guchar *row) {
-    // bang a bunch of pixels onto the current row, update and wrap if need be
+void sdr_waterfall_update(GtkWidget *widget, guchar *row, gint width) {
+    // write a row into the image over the oldest one, send just that strip to
+    // the server, and redraw the waterfall (but not the scale); a row made
+    // for an older view may not be the width of this one
     SDRWaterfall *wf = SDR_WATERFALL(widget);
     SDRWaterfallPrivate *priv = SDR_WATERFALL_GET_PRIVATE(wf);
+    guchar *data = cairo_image_surface_get_data(wf->image);
+    gint stride = cairo_image_surface_get_stride(wf->image);
+    gint n = MIN(width, wf->width);
+    guint32 *src = (guint32 *)row;
+    gint i;
 
-    //return;
-    cairo_t *cr = gdk_cairo_create (wf->pixmap);
-    cairo_surface_t *s_row = cairo_image_surface_create_for_data (
-        row,
-        CAIRO_FORMAT_RGB24,
-	wf_swap(wf->fft_size, 1),
-	(wf->orientation == WF_O_VERTICAL) ? (4*wf->fft_size) : 4
-    );
-
+    cairo_surface_flush(wf->image);
     g_mutex_lock(&priv->mutex);
-	switch (wf->orientation) {
-	case WF_O_VERTICAL:
-	    cairo_set_source_surface (cr, s_row, 0, priv->scroll_pos);
-	    break;
-	case WF_O_HORIZONTAL:
-	    cairo_set_source_surface (cr, s_row, priv->scroll_pos, 0);
-	    break;
-	}
-    cairo_paint(cr);
-    g_mutex_unlock(&priv->mutex);
+    switch (wf->orientation) {
+    case WF_O_VERTICAL:
+        memcpy(data + priv->scroll_pos * stride, row, n * 4);
+        break;
+    case WF_O_HORIZONTAL:
+        for (i = 0; i < n; i++)
+            *(guint32 *)(data + i * stride + priv->scroll_pos * 4) = src[i];
+        break;
+    }
+    cairo_surface_mark_dirty_rectangle(wf->image, wf_swap(0, priv->scroll_pos), wf_swap(n, 1));
+
+    cairo_rectangle(wf->pixmap_cr, wf_swap(0, priv->scroll_pos), wf_swap(n, 1));
+    cairo_fill(wf->pixmap_cr);
 
     priv->scroll_pos++;
     if (priv->scroll_pos >= wf->wf_height) priv->scroll_pos = 0;
+    g_mutex_unlock(&priv->mutex);
 
-    cairo_surface_destroy(s_row);
-    cairo_destroy(cr);
-    gtk_widget_queue_draw(widget);
-
+    gtk_widget_queue_draw_area(widget, wf_rectangle(0, 0, wf->width, wf->wf_height));
 }
 
 /* accessor functions */
@@ -609,4 +711,14 @@ void sdr_waterfall_set_highpass(SDRWaterfall *wf, gdouble value) {
     gtk_adjustment_set_lower(wf->lp_tune, value);
 }
 
+void sdr_waterfall_set_markers(SDRWaterfall *wf, gdouble *tuning, gint count, gint active) {
+    // tuning offsets in Hz for every receiver, active is the one under the cursor
+    gint i;
+    wf->markers = MIN(count, WF_MAX_MARKERS);
+    for (i = 0; i < wf->markers; i++)
+        wf->marker[i] = tuning[i];
+    wf->marker_active = active;
+    gtk_widget_queue_draw(GTK_WIDGET(wf));
+}
+
 /* vim: set noexpandtab ai ts=4 sw=4 tw=4: */
@@ -37,9 +37,13 @@ enum {
     P_TUNING,
     P_HIGHPASS,
     P_LOWPASS,
-    P_BANDSPREAD
+    P_BANDSPREAD,
+    P_PAN
 };
 
+#define WF_MAX_MARKERS 16
+#define WF_MAX_ZOOM 64
+
 enum {
     WF_O_VERTICAL,
     WF_O_HORIZONTAL
@@ -52,9 +56,12 @@ struct _SDRWaterfall {
     GtkAdjustment *lp_tune;
     GtkAdjustment *hp_tune;
 
+    // the waterfall is a ring of rows, scroll_pos being the oldest; new rows
+    // go straight into the image, and only that strip is copied to the pixmap
+    cairo_surface_t *image;
     GdkPixmap *pixmap;
+    cairo_t *pixmap_cr;     // draws the image into the pixmap, kept while realized
     GdkPixmap *scale;
-    cairo_surface_t *pix;
 
     gint mode;
     gint orientation;
@@ -65,6 +72,16 @@ struct _SDRWaterfall {
     gint sample_rate;
     gint centre_freq;
     gint fft_size;
+
+    // the part of the band on show: sample_rate/zoom wide, centred on view_centre Hz
+    gdouble zoom;
+    gdouble view_centre;
+    gint view_serial;   // bumped whenever the width, zoom or pan changes
+
+    // every receiver's tuning, drawn as a marker; the active one gets the cursor
+    gdouble marker[WF_MAX_MARKERS];
+    gint markers;
+    gint marker_active;
 };
 
 struct _SDRWaterfallClass {
@@ -79,6 +96,7 @@ struct _SDRWaterfallPrivate {
     gint prelight;
     gint drag;
     gint click_pos;
+    gdouble pan_centre; // view_centre when the pan drag started
     gdouble bandspread;
     GMutex mutex;
 };
@@ -98,7 +116,8 @@ G_END_DECLS
 
 #define SCALE_HEIGHT 24
 #define SCALE_WIDTH 50
-#define SCALE_TICK 5000
+#define SCALE_TICK 100   // smallest spacing of the scale ticks, in Hz
+#define SCALE_SPACING 60 // closest the ticks can get, in pixels
 
 SDRWaterfall *sdr_waterfall_new(GtkAdjustment *tuning, GtkAdjustment *lp_tune, GtkAdjustment *hp_tune, gint sample_rate, gint fft_size);
 float sdr_waterfall_get_tuning(SDRWaterfall *wf);
@@ -106,11 +125,12 @@ float sdr_waterfall_get_lowpass(SDRWaterfall *wf);
 float sdr_waterfall_get_highpass(SDRWaterfall *wf);
 
 void sdr_waterfall_set_tuning(SDRWaterfall *wf, gdouble value);
-void sdr_waterfall_update(GtkWidget *widget, guchar *row);
+void sdr_waterfall_update(GtkWidget *widget, guchar *row, gint width);
 void sdr_waterfall_set_scale(GtkWidget *widget, gint centre_freq);
 void sdr_waterfall_filter_cursors(SDRWaterfall *wf);
 void sdr_waterfall_set_lowpass(SDRWaterfall *wf, gdouble value);
 void sdr_waterfall_set_highpass(SDRWaterfall *wf, gdouble value);
+void sdr_waterfall_set_markers(SDRWaterfall *wf, gdouble *tuning, gint count, gint active);
 GType sdr_waterfall_get_type(void);
 #endif /* __WATERFALL_H */
 
@@ -0,0 +1,134 @@
+/*  lysdr Software Defined Radio
+	(C) 2010-2011 Gordon JC Pearce MM0YEQ and others
+
+	wisdom.c
+	keep FFTW's wisdom between runs, so plans can be measured without
+	making start-up slower
+
+	This file is part of lysdr.
+
+	lysdr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	any later version.
+
+	lysdr is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with lysdr.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <complex.h>
+#include <fftw3.h>
+#include <gtk/gtk.h>
+
+#include "sdr.h"
+#include "wisdom.h"
+
+// the planner isn't thread-safe; all of this runs on the main thread
+static gint loaded[WISDOM_MAX];		// sizes whose wisdom file we've read
+static gint n_loaded = 0;
+static gint missing[WISDOM_MAX];	// sizes we had to estimate this run
+static gint n_missing = 0;
+
+static gboolean wisdom_seen(gint *list, gint *count, gint n) {
+	// TRUE if n is already on the list, otherwise add it
+	gint i;
+	for (i = 0; i < *count; i++)
+		if (list[i] == n) return TRUE;
+	if (*count < WISDOM_MAX)
+		list[(*count)++] = n;
+	return FALSE;
+}
+
+static gchar *wisdom_file(gint n) {
+	// one file per size and precision, so each can be replanned on its own
+	gchar *name, *file;
+	name = g_strdup_printf("fftw-%s-%d.wisdom", WISDOM_PRECISION, n);
+	file = g_build_filename(g_get_user_cache_dir(), "lysdr", name, NULL);
+	g_free(name);
+	return file;
+}
+
+static gboolean wisdom_measure(gint n, guint flags) {
+	// plan both directions of one size from nothing, and keep the wisdom
+	FFTW(complex) *in, *out;
+	FFTW(plan) plan;
+	gchar *dir, *file;
+	gboolean ok;
+
+	FFTW(forget_wisdom)();	// only this size goes in its file
+	in = FFTW(malloc)(sizeof(FFTW(complex)) * n);
+	out = FFTW(malloc)(sizeof(FFTW(complex)) * n);
+	plan = FFTW(plan_dft_1d)(n, in, out, FFTW_FORWARD, flags);
+	FFTW(destroy_plan)(plan);
+	plan = FFTW(plan_dft_1d)(n, in, out, FFTW_BACKWARD, flags);
+	FFTW(destroy_plan)(plan);
+	FFTW(free)(in);
+	FFTW(free)(out);
+
+	dir = g_build_filename(g_get_user_cache_dir(), "lysdr", NULL);
+	g_mkdir_with_parents(dir, 0755);
+	file = wisdom_file(n);
+	ok = FFTW(export_wisdom_to_filename)(file);
+	if (!ok)
+		fprintf(stderr, "can't save FFT wisdom to %s\n", file);
+	g_free(file);
+	g_free(dir);
+	return ok;
+}
+
+FFTW(plan) wisdom_plan(gint n, FFTW(complex) *in, FFTW(complex) *out, gint sign) {
+	// plan a complex FFT; measured if there's wisdom for it, estimated if not
+	// this never measures anything itself, so it costs no start-up time
+	FFTW(plan) plan;
+	gchar *file;
+
+	if (!wisdom_seen(loaded, &n_loaded, n)) {
+		file = wisdom_file(n);
+		FFTW(import_wisdom_from_filename)(file);	// fine if it isn't there
+		g_free(file);
+	}
+	plan = FFTW(plan_dft_1d)(n, in, out, sign, FFTW_MEASURE | FFTW_WISDOM_ONLY);
+	if (!plan) {
+		wisdom_seen(missing, &n_missing, n);
+		plan = FFTW(plan_dft_1d)(n, in, out, sign, FFTW_ESTIMATE);
+	}
+	return plan;
+}
+
+void wisdom_save(void) {
+	// measure the sizes we had to estimate, so they're planned properly next time
+	// call this on the way out, once nothing else is planning
+	gint i;
+	for (i = 0; i < n_missing; i++)
+		wisdom_measure(missing[i], FFTW_MEASURE);
+	n_missing = 0;
+}
+
+gboolean wisdom_plan_sizes(const gchar *sizes) {
+	// plan a comma-separated list of sizes with FFTW_PATIENT, for --plan-fft
+	gchar **list = g_strsplit(sizes, ",", 0);
+	gboolean ok = TRUE;
+	gint i, n;
+
+	for (i = 0; list[i]; i++) {
+		n = atoi(list[i]);
+		if (n < 2) {
+			fprintf(stderr, "bad FFT size \"%s\"\n", list[i]);
+			ok = FALSE;
+			continue;
+		}
+		printf("planning %d point FFT (%s)\n", n, WISDOM_PRECISION);
+		ok &= wisdom_measure(n, FFTW_PATIENT);
+	}
+	g_strfreev(list);
+	return ok;
+}
+
+/* vim: set noexpandtab ai ts=4 sw=4 tw=4: */
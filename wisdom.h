@@ -0,0 +1,42 @@
+/*  lysdr Software Defined Radio
+	(C) 2010-2011 Gordon JC Pearce MM0YEQ and others
+
+	wisdom.h
+
+	This file is part of lysdr.
+
+	lysdr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	any later version.
+
+	lysdr is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with lysdr.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __WISDOM_H
+#define __WISDOM_H
+
+#include <gtk/gtk.h>
+#include "sdr.h"
+
+#define WISDOM_MAX 32	// distinct FFT sizes in one run
+
+#ifdef SDR_SINGLE
+#define WISDOM_PRECISION "single"
+#else
+#define WISDOM_PRECISION "double"
+#endif
+
+FFTW(plan) wisdom_plan(gint n, FFTW(complex) *in, FFTW(complex) *out, gint sign);
+void wisdom_save(void);
+gboolean wisdom_plan_sizes(const gchar *sizes);
+
+#endif
+
+/* vim: set noexpandtab ai ts=4 sw=4 tw=4: */